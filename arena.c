@@ -0,0 +1,37 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "arena.h"
+
+int
+mkarena(struct arena *const a, const size_t size)
+{
+	void *p;
+	a->size = ARENA_SIZE(size);
+	a->used = 0;
+	if (posix_memalign(&p, ARENA_ALIGN, a->size ? a->size : ARENA_ALIGN))
+		return 0;
+	a->base = p;
+	return 1;
+}
+
+/* NULL once the arena is full, which means it was sized wrong */
+void *
+arenaget(struct arena *const a, const size_t size)
+{
+	void *p;
+	if (ARENA_SIZE(size) > a->size - a->used)
+		return NULL;
+	p = a->base + a->used;
+	a->used += ARENA_SIZE(size);
+	return p;
+}
+
+void
+freearena(struct arena *const a)
+{
+	free(a->base);
+	a->base = NULL;
+	a->size = a->used = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* a cache line, and enough for any vector load */
+#define ARENA_ALIGN 64
+#define ARENA_SIZE(n) (((n) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+/* one allocation carved into aligned blocks, all freed at once */
+struct arena {
+	char *base;
+	size_t size, used;
+};
+
+int mkarena(struct arena *const a, const size_t size);
+void *arenaget(struct arena *const a, const size_t size);
+void freearena(struct arena *const a);
+
+#endif
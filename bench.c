@@ -0,0 +1,283 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mat.h"
+#include "mesh.h"
+#include "pace.h"
+#include "rng.h"
+#include "sim.h"
+
+/*
+ * Microbenchmarks for the CPU side. Every (kernel, grid) pair is timed over
+ * a number of runs, each one long enough to dwarf the clock resolution, and
+ * printed as a CSV line on stdout. Times are per item: a vertex for the
+ * grid kernels, a call for the matrices.
+ *
+ * With -a, it prints the size and vertex cache behaviour of each index
+ * layout instead.
+ */
+
+#define MIN_RUN 0.01
+#define MAX_RUNS 64
+
+struct bench {
+	const char *name;
+	size_t width, height, items, threads;
+	double ns[MAX_RUNS];
+	size_t runs;
+};
+
+struct grid {
+	size_t width, height;
+	float *z;
+	GLfloat *vert;
+	GLuint *ind;
+	struct wave w;
+	struct pool pool;
+};
+
+static volatile float sink;
+
+static const size_t sizes[][2] = {
+	{ 16, 9 },
+	{ 64, 36 },
+	{ 256, 144 },
+	{ 640, 360 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 2048, 1152 },
+};
+
+static int
+cmpdouble(const void *a, const void *b)
+{
+	const double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void
+report(struct bench *const b)
+{
+	double mean = 0.0, var = 0.0;
+	size_t i;
+	for (i = 0; i < b->runs; ++i)
+		mean += b->ns[i];
+	mean /= b->runs;
+	for (i = 0; i < b->runs; ++i)
+		var += (b->ns[i] - mean) * (b->ns[i] - mean);
+	var /= b->runs > 1 ? b->runs - 1 : 1;
+	qsort(b->ns, b->runs, sizeof(*b->ns), cmpdouble);
+	printf("%s,%zu,%zu,%zu,%zu,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f\n",
+	       b->name, b->width, b->height, b->threads, b->items, b->runs,
+	       mean, var, sqrt(var), b->ns[0], b->ns[b->runs / 2],
+	       1e3 / b->ns[b->runs / 2]);
+	fflush(stdout);
+}
+
+/* the batch size is picked once so that every run takes about MIN_RUN */
+#define TIME(b, body) do { \
+	size_t reps = 1, rep, run; \
+	double dt; \
+	for (;;) { \
+		dt = monotime(); \
+		for (rep = 0; rep < reps; ++rep) { body; } \
+		if ((dt = monotime() - dt) >= MIN_RUN || reps >= 1u << 30) \
+			break; \
+		reps *= dt > 0.0 && MIN_RUN / dt < 16 ? 2 : 16; \
+	} \
+	for (run = 0; run < (b)->runs; ++run) { \
+		dt = monotime(); \
+		for (rep = 0; rep < reps; ++rep) { body; } \
+		(b)->ns[run] = (monotime() - dt) * 1e9 / reps / (b)->items; \
+	} \
+	report(b); \
+} while (0)
+
+static int
+mkgrid(struct grid *const g, const size_t width, const size_t height,
+       const size_t threads)
+{
+	const size_t n = numvert(width, height);
+	size_t i;
+	g->width = width;
+	g->height = height;
+	g->z = malloc(3 * n * sizeof(*g->z));
+	g->vert = malloc(3 * n * sizeof(*g->vert));
+	g->ind = malloc(numind(width, height) * sizeof(*g->ind));
+	if (!g->z || !g->vert || !g->ind) {
+		free(g->z);
+		free(g->vert);
+		free(g->ind);
+		return 0;
+	}
+	g->w.width = width;
+	g->w.height = height;
+	g->w.cur = g->z;
+	g->w.prev = g->z + n;
+	g->w.next = g->z + 2 * n;
+	g->w.seed = 1;
+	g->w.step = 0;
+	for (i = 0; i < n; ++i)
+		g->w.cur[i] = g->w.prev[i] = (float) ((int) (rng(1 ^ RNG_HEIGHTS, i) % 128) - 64) / 256;
+	mkpool(&g->pool, &g->w, threads);
+	return 1;
+}
+
+static void
+freegrid(struct grid *const g)
+{
+	freepool(&g->pool);
+	free(g->z);
+	free(g->vert);
+	free(g->ind);
+}
+
+static void
+benchgrid(const size_t width, const size_t height, const size_t runs,
+          const size_t threads)
+{
+	const size_t n = numvert(width, height);
+	struct bench b;
+	struct grid g;
+	size_t sz, v;
+	if (!mkgrid(&g, width, height, threads)) {
+		fprintf(stderr, "bench: no memory for %zux%zu\n", width, height);
+		return;
+	}
+	b.width = width;
+	b.height = height;
+	b.items = n;
+	b.threads = 1;
+	b.runs = runs;
+
+	b.name = "force";
+	TIME(&b, for (v = 0; v < n; ++v)
+		sink = force(width, height, g.w.cur, g.w.prev, v));
+	b.name = "move";
+	TIME(&b, move(&g.w));
+	b.name = "poolmove";
+	b.threads = g.pool.nthreads;
+	TIME(&b, poolmove(&g.pool));
+	b.threads = 1;
+	b.name = "initvert";
+	TIME(&b, initvert(width, height, g.vert));
+	b.name = "initind";
+	TIME(&b, initind(width, height, g.ind));
+	b.name = "initstrip";
+	TIME(&b, initstrip(width, height, g.ind, indtype(width, height)));
+	b.name = "initclothvert";
+	TIME(&b, free(initclothvert(width, height, &sz, 1)));
+	b.name = "initclothtri";
+	TIME(&b, free(initclothtri(width, height, &sz)));
+	freegrid(&g);
+}
+
+static void
+benchmat(const size_t runs)
+{
+	GLfloat mat[16];
+	struct bench b;
+	float a = 0.0f;
+	b.width = b.height = 0;
+	b.items = b.threads = 1;
+	b.runs = runs;
+	b.name = "matcam";
+	TIME(&b, matcam(mat, 0.5f, 0.05f, a += 0.001f); sink = mat[12]);
+	b.name = "matproj";
+	TIME(&b, matproj(mat, 0.75f + a, 0.75f * 9.0f / 16.0f, 0.01f, 4.0f); sink = mat[0]);
+}
+
+/* average cache miss ratio of the triangle list and of the strips */
+static void
+benchacmr(const size_t width, const size_t height)
+{
+	static const size_t caches[] = { 16, 32 };
+	const GLenum type = indtype(width, height);
+	const size_t nlist = numind(width, height);
+	const size_t nstrip = numstrip(width, height);
+	GLuint *list = malloc(nlist * sizeof(*list));
+	void *strip = malloc(nstrip * indsize(type));
+	size_t i;
+	if (!list || !strip) {
+		fprintf(stderr, "bench: no memory for %zux%zu\n", width, height);
+		goto end;
+	}
+	initind(width, height, list);
+	initstrip(width, height, strip, type);
+	for (i = 0; i < sizeof(caches) / sizeof(*caches); ++i) {
+		printf("list,%zu,%zu,%zu,%zu,%zu,%.4f\n", width, height,
+		       caches[i], nlist, nlist * sizeof(*list),
+		       acmr(list, nlist, GL_UNSIGNED_INT, GL_TRIANGLES, caches[i]));
+		printf("strip,%zu,%zu,%zu,%zu,%zu,%.4f\n", width, height,
+		       caches[i], nstrip, nstrip * indsize(type),
+		       acmr(strip, nstrip, type, GL_TRIANGLE_STRIP, caches[i]));
+	}
+	end:
+	free(list);
+	free(strip);
+}
+
+static void
+usage(void)
+{
+	fputs("usage: bench [-a] [-r runs] [-t threads] [-s widthxheight]\n", stderr);
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t runs = 15, width = 0, height = 0, i;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	char *end;
+	int a, layouts = 0;
+	for (a = 1; a < argc; ++a) {
+		if (!strcmp(argv[a], "-a")) {
+			layouts = 1;
+		} else if (!strcmp(argv[a], "-r") && a + 1 < argc) {
+			runs = strtoul(argv[++a], &end, 10);
+			if (*end || runs < 1 || runs > MAX_RUNS)
+				goto errusage;
+		} else if (!strcmp(argv[a], "-t") && a + 1 < argc) {
+			threads = strtol(argv[++a], &end, 10);
+			if (*end || threads < 1)
+				goto errusage;
+		} else if (!strcmp(argv[a], "-s") && a + 1 < argc) {
+			if (sscanf(argv[++a], "%zux%zu", &width, &height) != 2
+			    || width < 2 || height < 2)
+				goto errusage;
+		} else {
+			goto errusage;
+		}
+	}
+	if (threads < 1)
+		threads = 1;
+	if (layouts) {
+		puts("layout,width,height,cache,indices,bytes,acmr");
+		if (width) {
+			benchacmr(width, height);
+		} else {
+			for (i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+				benchacmr(sizes[i][0], sizes[i][1]);
+		}
+		return EXIT_SUCCESS;
+	}
+	puts("kernel,width,height,threads,items,runs,ns_mean,ns_var,ns_sd,"
+	     "ns_min,ns_median,mitems_per_s");
+	benchmat(runs);
+	if (width) {
+		benchgrid(width, height, runs, threads);
+	} else {
+		for (i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+			benchgrid(sizes[i][0], sizes[i][1], runs, threads);
+	}
+	return EXIT_SUCCESS;
+
+	errusage:
+	usage();
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dump.h"
+
+/* stdio's buffer, a few rows' worth */
+#define DUMP_BUFFER (1 << 20)
+
+int
+mkdump(struct dump *const d, const char *spec, const int width,
+       const int height, const double fps)
+{
+	d->y4m = 1;
+	if (!strncmp(spec, "y4m:", 4)) {
+		spec += 4;
+	} else if (!strncmp(spec, "bgra:", 5)) {
+		d->y4m = 0;
+		spec += 5;
+	}
+	d->width = width;
+	d->height = height;
+	d->frames = 0;
+	d->failed = 0;
+	d->planes = NULL;
+	if (d->y4m && !(d->planes = malloc(3 * (size_t) width * height))) {
+		fputs("Error: not enough memory to convert frames.\n", stderr);
+		return 0;
+	}
+	d->f = strcmp(spec, "-") ? fopen(spec, "wb") : stdout;
+	if (!d->f) {
+		fprintf(stderr, "Error: cannot write %s.\n", spec);
+		free(d->planes);
+		return 0;
+	}
+	setvbuf(d->f, NULL, _IOFBF, DUMP_BUFFER);
+	if (d->y4m)
+		fprintf(d->f, "YUV4MPEG2 W%d H%d F%ld:1000 Ip A1:1 C444\n", width,
+		        height, lround(fps * 1000.0));
+	return 1;
+}
+
+/* the conversion is done in whole numbers, and stays positive for >> */
+static void
+toyuv(const unsigned char *const px, const int width, const int height,
+      unsigned char *const planes)
+{
+	const size_t n = (size_t) width * height;
+	const unsigned char *row, *p;
+	unsigned char *y = planes, *u = planes + n, *v = planes + 2 * n;
+	int r, g, b, i, j;
+	for (i = height - 1; i >= 0; --i) {
+		row = px + (size_t) i * width * 4;
+		for (j = 0; j < width; ++j) {
+			p = row + 4 * j;
+			b = p[0];
+			g = p[1];
+			r = p[2];
+			*y++ = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+			*u++ = ((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+			*v++ = ((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+		}
+	}
+}
+
+int
+dumpframe(struct dump *const d, const void *const px)
+{
+	const size_t rowsize = (size_t) d->width * 4;
+	const unsigned char *const rows = px;
+	int i;
+	if (d->failed)
+		return 0;
+	if (d->y4m) {
+		toyuv(px, d->width, d->height, d->planes);
+		fputs("FRAME\n", d->f);
+		fwrite(d->planes, 3 * (size_t) d->width, d->height, d->f);
+	} else {
+		for (i = d->height - 1; i >= 0; --i)
+			fwrite(rows + i * rowsize, rowsize, 1, d->f);
+	}
+	if (ferror(d->f)) {
+		fputs("Error: failed to write a frame.\n", stderr);
+		d->failed = 1;
+		return 0;
+	}
+	++d->frames;
+	return 1;
+}
+
+void
+freedump(struct dump *const d)
+{
+	if (fclose(d->f) && !d->failed) {
+		fputs("Error: failed to write the last frames.\n", stderr);
+		d->failed = 1;
+	}
+	free(d->planes);
+}
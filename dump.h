@@ -0,0 +1,27 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdio.h>
+
+/*
+ * Frames written out as they come from glReadPixels(), BGRA rows bottom up.
+ * A spec is a path, - for stdout, behind an optional y4m: or bgra: prefix;
+ * y4m is the default. Y4M frames are 4:4:4 so that no colour is averaged
+ * away, in BT.601 studio range; bgra ones are the bytes as they are, top
+ * down, with no header at all. Once a write failed, failed is set and the
+ * rest are refused.
+ */
+struct dump {
+	FILE *f;
+	int y4m, width, height;
+	unsigned char *planes;
+	unsigned long frames;
+	int failed;
+};
+
+int mkdump(struct dump *const d, const char *spec, const int width,
+           const int height, const double fps);
+int dumpframe(struct dump *const d, const void *const px);
+void freedump(struct dump *const d);
+
+#endif
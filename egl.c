@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "output.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+/*
+ * Headless output: an EGL context with no surface at all, drawing into a
+ * multisampled framebuffer object that is resolved on every present. Works
+ * on Mesa's llvmpipe with neither a GPU nor an X server.
+ */
+struct egl {
+	EGLDisplay disp;
+	EGLContext context;
+	GLuint msfbo, rbo[3];
+	GLsync fence;
+};
+
+/* keeps at most one frame in flight, like a swap chain would */
+static void
+eglpresent(struct output *const o)
+{
+	struct egl *const e = o->data;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, e->msfbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, o->fbo);
+	glBlitFramebuffer(0, 0, o->width, o->height, 0, 0, o->width, o->height,
+	                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, e->msfbo);
+	if (e->fence) {
+		glClientWaitSync(e->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(e->fence);
+	}
+	e->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static void
+eglclose(struct output *const o)
+{
+	struct egl *const e = o->data;
+	if (e->fence)
+		glDeleteSync(e->fence);
+	glDeleteFramebuffers(1, &o->fbo);
+	glDeleteFramebuffers(1, &e->msfbo);
+	glDeleteRenderbuffers(3, e->rbo);
+	eglMakeCurrent(e->disp, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(e->disp, e->context);
+	eglTerminate(e->disp);
+	free(e);
+}
+
+/*
+ * Mesa's surfaceless platform where there is one, else the default display,
+ * initialized; EGL_NO_DISPLAY if neither comes up.
+ */
+static EGLDisplay
+getdisplay(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getplatformdisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay disp;
+	if (getplatformdisplay) {
+		disp = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (disp != EGL_NO_DISPLAY && eglInitialize(disp, NULL, NULL))
+			return disp;
+	}
+	disp = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (disp != EGL_NO_DISPLAY && eglInitialize(disp, NULL, NULL))
+		return disp;
+	return EGL_NO_DISPLAY;
+}
+
+int
+mkeglout(struct output *const o, const int width, const int height,
+         int msaa)
+{
+	const EGLint confattr[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	const EGLint contextattr[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	struct egl *e;
+	EGLConfig conf;
+	EGLint numconf;
+	GLint maxsamples;
+	GLenum r;
+	if (!(e = calloc(1, sizeof(*e)))) {
+		fputs("Error: failed to allocate the headless output.\n", stderr);
+		return 0;
+	}
+	e->disp = getdisplay();
+	if (e->disp == EGL_NO_DISPLAY) {
+		fputs("Error: failed to open an EGL display.\n", stderr);
+		goto errdisp;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)
+	    || !eglChooseConfig(e->disp, confattr, &conf, 1, &numconf) || !numconf) {
+		fputs("Error: no EGL config found.\n", stderr);
+		goto errinit;
+	}
+	e->context = eglCreateContext(e->disp, conf, EGL_NO_CONTEXT, contextattr);
+	if (e->context == EGL_NO_CONTEXT) {
+		fputs("Error: failed to create an OpenGL context.\n", stderr);
+		goto errinit;
+	}
+	if (!eglMakeCurrent(e->disp, EGL_NO_SURFACE, EGL_NO_SURFACE, e->context)) {
+		fputs("Error: failed to make the headless context current.\n", stderr);
+		goto errcontext;
+	}
+	glewExperimental = GL_TRUE;
+	r = glewInit();
+	/* a GLX build of GLEW loads everything, then complains about GLX */
+	if (r != GLEW_OK && r != GLEW_ERROR_NO_GLX_DISPLAY) {
+		fputs("Failed to initialize GLEW.\n", stderr);
+		goto errcurrent;
+	}
+
+	glGetIntegerv(GL_MAX_SAMPLES, &maxsamples);
+	if (msaa > maxsamples)
+		msaa = maxsamples;
+	glGenRenderbuffers(3, e->rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, e->rbo[0]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, msaa, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, e->rbo[1]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, msaa, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, e->rbo[2]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenFramebuffers(1, &o->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, o->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, e->rbo[2]);
+	glGenFramebuffers(1, &e->msfbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, e->msfbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, e->rbo[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, e->rbo[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fputs("Error: incomplete headless framebuffer.\n", stderr);
+		glDeleteFramebuffers(1, &o->fbo);
+		glDeleteFramebuffers(1, &e->msfbo);
+		glDeleteRenderbuffers(3, e->rbo);
+		goto errcurrent;
+	}
+
+	o->width = width;
+	o->height = height;
+	o->nmonitors = 1;
+	o->monitors[0].x = o->monitors[0].y = 0;
+	o->monitors[0].width = width;
+	o->monitors[0].height = height;
+	o->layout = 0;
+	o->present = eglpresent;
+	o->visible = NULL;
+	o->close = eglclose;
+	o->data = e;
+	return 1;
+
+	errcurrent:
+	eglMakeCurrent(e->disp, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	errcontext:
+	eglDestroyContext(e->disp, e->context);
+	errinit:
+	eglTerminate(e->disp);
+	errdisp:
+	free(e);
+	return 0;
+}
@@ -1,44 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <math.h>
+#include <poll.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 #include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xrandr.h>
 #include <X11/extensions/Xrender.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GL/glx.h>
 
-#define SQRT3_2 0.8660254037844386f
-#define SQRT3 1.7320508075688772f
+#include "arena.h"
+#include "dump.h"
+#include "gov.h"
+#include "gpusim.h"
+#include "loop.h"
+#include "mat.h"
+#include "mesh.h"
+#include "output.h"
+#include "pace.h"
+#include "prof.h"
+#include "readback.h"
+#include "ring.h"
+#include "scale.h"
+#include "sim.h"
+
 #define TWO_PI 6.283185307179586f
 #define LOG_MAX_LENGTH 512
+/* -c: how far a channel may stray, and how many pixels in a million may */
+#define CHECK_TOLERANCE 2
+#define CHECK_PPM 1000
+/* -c with -G: how far the GPU's heights may drift from the CPU's */
+#define CHECK_SIM 1e-4
+/* steps the GPU may run back to back to catch up, like PACE_MAX_LAG */
+#define GPU_MAX_LAG 4
+/* samples per pixel */
+#define MSAA 8
+/* seconds per turn of the camera, which matcam() gets half the time as */
+#define CAMERA_PERIOD (2.0 * TWO_PI)
+/* -l: seconds of a loop's end that fade into its start */
+#define LOOP_BLEND 0.5
+/* and the time of day it is lit at, noon, as a replay may come at any hour */
+#define LOOP_DAY 0.5
+#define LOOP_MAX_PATH 4096
 
 /* normally declared in math.h */
 #ifndef M_PI_2
 #define M_PI_2 1.5707963267948966f
 #endif
 
-#define Z_COORD(v, i) v[3 * (i) + 2]
+/* simulation steps per second */
+#define STEP_RATE 15
 
 typedef GLXContext (*glXCreateContextAttribsARBProc)(Display*, GLXFBConfig,
                                                      GLXContext, Bool,
                                                      const int*);
+typedef int (*glXSwapIntervalMESAProc)(unsigned int);
+
+/* settings from the command line */
+struct conf {
+	size_t threads;
+	double fps;
+	int vsync;
+	int headless;
+	int bkg;
+	int width, height;
+	size_t gwidth, gheight;
+	unsigned long frames;
+	size_t upsample;
+	int check;
+	int gpu;
+	const char *prof;
+	uint64_t seed;
+	float scale;
+	double budget;
+	double cpushare, gpushare;
+	double loop;
+	const char *dump;
+};
+
+/* uniform block binding for the per-frame state */
+#define FRAME_BINDING 0
+
+/* std140, laid out like struct frame */
+#define FRAME_BLOCK \
+	"layout (std140) uniform frame {\n" \
+	"    mat4 projection;\n" \
+	"    mat4 view;\n" \
+	"    vec3 light;\n" \
+	"};\n"
+
+/* projection comes first: it never changes, so updates start at view */
+struct frame {
+	GLfloat projection[16];
+	GLfloat view[16];
+	GLfloat light[4];
+};
 
 static const GLchar *vshadersrc =
 	"#version 330 core\n"
-	"layout (location = 0) in vec3 position;\n"
-	"out vec3 vnormal;\n"
-	"uniform mat4 view;\n"
-	"uniform mat4 projection;\n"
+	"layout (location = 0) in vec2 xy;\n"
+	"layout (location = 1) in float z;\n"
+	"out vec3 pos;\n"
+	FRAME_BLOCK
+	"void main()\n"
+	"{\n"
+	"    gl_Position = projection * view * vec4(xy, z, 1.0);\n"
+	"    pos = gl_Position.xyz;\n"
+	"}";
+
+/*
+ * Same web drawn from a heightmap, factor times denser than the grid. The
+ * dense mesh is a lattice of its own, its odd rows half a dense cell over as
+ * initstrip() expects. Heights are looked up where each vertex lies in the
+ * grid's lattice, whose odd rows are half a cell over, with that shift
+ * blended in between rows.
+ */
+static const GLchar *vhmapsrc =
+	"#version 330 core\n"
+	"uniform sampler2D heightmap;\n"
+	"uniform int meshwidth;\n"
+	"uniform int factor;\n"
+	"uniform vec3 lattice;\n"
+	"out vec3 pos;\n"
+	FRAME_BLOCK
+	"void main()\n"
+	"{\n"
+	"    vec2 cell = vec2(gl_VertexID % meshwidth, gl_VertexID / meshwidth);\n"
+	"    vec2 uv = vec2(cell.x + mod(cell.y, 2.0) / 2.0, cell.y) / float(factor);\n"
+	"    float r = floor(uv.y);\n"
+	"    float shift = mix(mod(r, 2.0), mod(r + 1.0, 2.0), uv.y - r) / 2.0;\n"
+	"    float z;\n"
+	"    if (factor == 1)\n"
+	"        z = texelFetch(heightmap, ivec2(cell), 0).r;\n"
+	"    else\n"
+	"        z = texture(heightmap, (vec2(uv.x - shift, uv.y) + 0.5) / vec2(textureSize(heightmap, 0))).r;\n"
+	"    gl_Position = projection * view * vec4(uv.x * lattice.x - 1.0, uv.y * lattice.y - lattice.z, z, 1.0);\n"
+	"    pos = gl_Position.xyz;\n"
+	"}";
+
+/*
+ * The derivatives of pos span the triangle's plane, so their cross product is
+ * the flat normal; flipped on back faces to keep the vertex order's sign.
+ */
+static const GLchar *fshadersrc =
+	"#version 330 core\n"
+	"in vec3 pos;\n"
+	"out vec4 color;\n"
+	FRAME_BLOCK
+	"void main()\n"
+	"{\n"
+	"    vec3 normal = normalize(cross(dFdx(pos), dFdy(pos)));\n"
+	"    if (!gl_FrontFacing)\n"
+	"        normal = -normal;\n"
+	"    float a = -dot(normal, light);\n"
+	"    color = vec4(0.5f * (1 + a), 0.375f * (1 + a), 0.0f, 1.0f);\n"
+	"}";
+
+/* a triangle covering the whole target, for full screen passes */
+static const GLchar *vquadsrc =
+	"#version 330 core\n"
 	"void main()\n"
 	"{\n"
-	"    gl_Position = projection * view * vec4(position, 1.0);\n"
+	"    gl_Position = vec4(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0, 0.0, 1.0);\n"
 	"}";
 
+/*
+ * One step of the wave per texel, following force() term by term. An odd
+ * row sees the rows around it at its column and the next, an even row at
+ * the previous column and its own.
+ */
+static const GLchar *fsimsrc =
+	"#version 330 core\n"
+	"uniform sampler2D cur;\n"
+	"uniform sampler2D prev;\n"
+	"uniform sampler2D kick;\n"
+	"uniform vec4 kpfh;\n"
+	"out float next;\n"
+	"float z;\n"
+	"float pull(int x, int y)\n"
+	"{\n"
+	"    return z - texelFetch(cur, ivec2(x, y), 0).r;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"    ivec2 size = textureSize(cur, 0);\n"
+	"    int x = int(gl_FragCoord.x), y = int(gl_FragCoord.y);\n"
+	"    int o = y % 2 == 1 ? 0 : -1;\n"
+	"    float a = 0.0, f;\n"
+	"    z = texelFetch(cur, ivec2(x, y), 0).r;\n"
+	"    if (x > 0) {\n"
+	"        a -= pull(x - 1, y);\n"
+	"        if (y > 0)\n"
+	"            a -= pull(x + o, y - 1);\n"
+	"        if (y + 1 < size.y)\n"
+	"            a -= pull(x + o, y + 1);\n"
+	"    }\n"
+	"    if (x + 1 < size.x) {\n"
+	"        a -= pull(x + 1, y);\n"
+	"        if (y > 0)\n"
+	"            a -= pull(x + o + 1, y - 1);\n"
+	"        if (y + 1 < size.y)\n"
+	"            a -= pull(x + o + 1, y + 1);\n"
+	"    }\n"
+	"    float zp = texelFetch(prev, ivec2(x, y), 0).r;\n"
+	"    if (x == 0 && texelFetch(kick, ivec2(y, 0), 0).r > 0.5)\n"
+	"        f = 2.0;\n"
+	"    else\n"
+	"        f = kpfh.y * a - kpfh.x * z - kpfh.z * (z - zp);\n"
+	"    next = 2.0 * z - zp + f * kpfh.w * kpfh.w;\n"
+	"}";
+
+/* the old pipeline, only kept for -c to compare against */
 static const GLchar *gshadersrc =
 	"#version 330 core\n"
 	"layout (triangles) in;\n"
@@ -53,244 +239,32 @@ static const GLchar *gshadersrc =
 	"    }\n"
 	"}";
 
-static const GLchar *fshadersrc =
+static const GLchar *fgeomsrc =
 	"#version 330 core\n"
 	"in vec3 normal;\n"
 	"out vec4 color;\n"
-	"uniform vec3 light;\n"
+	FRAME_BLOCK
 	"void main()\n"
 	"{\n"
 	"    float a = -dot(normal, light);\n"
 	"    color = vec4(0.5f * (1 + a), 0.375f * (1 + a), 0.0f, 1.0f);\n"
 	"}";
 
-static int sigclose = 0;
+static volatile sig_atomic_t sigclose = 0;
+static volatile sig_atomic_t sigprof = 0;
 
+/* not called kill, POSIX already has one */
 void
-kill(int param)
+term(int param)
 {
 	sigclose = 1;
 }
 
-float
-sqr(const float x)
-{
-	return x * x;
-}
-
-size_t
-numvert(const size_t width, const size_t height)
-{
-	return width * height;
-}
-
-size_t
-numind(const size_t width, const size_t height)
-{
-	return 6 * (width - 1) * (height - 1);
-}
-
-void
-initvert(const size_t width, const size_t height, GLfloat v[])
-{
-	const size_t n = numvert(width, height);
-	const GLfloat side = fminf(2.0f / (width - 0.5f), 4.0f / (height - 1) * SQRT3);
-	const GLfloat dy = side * SQRT3_2;
-	const GLfloat offy = (height - 1) * dy / 2.0f;
-	if (n) {
-		for (size_t i = 0; i < n; ++i) {
-			v[3 * i] = (i % width) * side - 1.0f;
-			if (i / width % 2)
-				v[3 * i] += side / 2.0f;
-			v[3 * i + 1] = (i / width) * dy - offy;
-			v[3 * i + 2] = 0.0f; //(i == 72)? 0.5f : 0.0f; //(GLfloat) (rand() % 32 - 16) / 256 - 0.75f;
-		}
-	}
-}
-
-void
-initind(const size_t width, const size_t height, GLuint ind[])
-{
-	const size_t n = numvert(width, height);
-	size_t i = 0;
-	if (numind(width, height)) {
-		for (size_t v = 0; v < n - width; ++v) {
-			if (!((v + 1) % width))
-				continue;
-			ind[i++] = v;
-			ind[i++] = v + width;
-			if (i / width % 2) {
-				ind[i++] = v + width + 1;
-				ind[i++] = v;
-				ind[i++] = v + width + 1;
-				ind[i++] = v + 1;
-			} else {
-				ind[i++] = v + 1;
-				ind[i++] = v + 1;
-				ind[i++] = v + width;
-				ind[i++] = v + width + 1;
-			}
-		}
-	}
-}
-
-void
-matproj(GLfloat mat[16], const float hfov, const float vfov,
-        const float n, const float f)
-{
-	const GLfloat d = f - n;
-	mat[0] = 1.0f / tan(hfov);
-	mat[1] = 0.0f;
-	mat[2] = 0.0f;
-	mat[3] = 0.0f;
-	mat[4] = 0.0f;
-	mat[5] = 1.0f / tan(vfov);
-	mat[6] = 0.0f;
-	mat[7] = 0.0f;
-	mat[8] = 0.0f;
-	mat[9] = 0.0f;
-	mat[10] = - (f + n) / d;
-	mat[11] = -1.0f;
-	mat[12] = 0.0f;
-	mat[13] = 0.0f;
-	mat[14] = -2 * f * n / d;
-	mat[15] = 0.0f;
-}
-
-void
-matcam(GLfloat mat[16], const float d, const float r, const float a)
-{
-	const float x = r * cosf(a);
-	const float y = r * sinf(a);
-	const float n = sqrtf(sqr(d) + sqr(r));
-	const float root = sqrtf(1.0f - sqr(y / d));
-	mat[0] = (d + sqr(y) / d) / (n * root);
-	mat[1] = 0.0f;
-	mat[2] = x / n;
-	mat[3] = 0.0f;
-	
-	mat[4] = -x * y / (n * root * d);
-	mat[5] = 1 / root;
-	mat[6] = y / n;
-	mat[7] = 0.0f;
-
-	mat[8] = -x / (n * root);
-	mat[9] = -y / (root * d);
-	mat[10] = d / n;
-	mat[11] = 0.0f;
-
-	mat[12] = -x * mat[0] - y * mat[4] - d * mat[8];
-	mat[13] = -x * mat[5] - d * mat[9];
-	mat[14] = -(sqr(r) + sqr(d)) / n;
-	mat[15] = 1.0f;
-}
-
-void
-matid(GLfloat mat[16])
-{
-	size_t i, j;
-	for (i = 0; i < 4; ++i) {
-		for (j = 0; j < 4; ++j)
-			mat[4 * i + j] = i == j;
-	}
-}
-
-void
-randomize(const size_t width, const size_t height, GLfloat *const a)
-{
-	size_t i, j;
-	for (i = 0; i < height; ++i) {
-		for (j = 0; j < width; ++j)
-			a[3 * (i * width + j) + 2] = (float) (rand() % 128 - 64) / 256 - 0.75f;
-	}
-}
-
-float
-force(const size_t width, const size_t height,
-      float vcur[], float vprev[], const size_t i)
-{
-	const float k = 0.125;
-	const float p = 0.1;
-	const float f = 0.5;
-	const float z = Z_COORD(vcur, i);
-	float a = 0.0f;
-
-	/* left */
-	if (i % width) {
-		a -= z - Z_COORD(vcur, i - 1);
-		if (i / width % 2) {
-			/* row 0 is never odd */
-			a -= z - Z_COORD(vcur, i - width);
-			if (i / width + 1 < height)
-				a -= z - Z_COORD(vcur, i + width);
-		} else {
-			if (i > width)
-				a -= z - Z_COORD(vcur, i - width - 1);
-			if (i / width + 1 < height)
-				a -= z - Z_COORD(vcur, i + width - 1);
-		}
-	}
-
-	/* right */
-	if ((i + 1) % width) {
-		a -= z - Z_COORD(vcur, i + 1);
-		if (i / width % 2) {
-			/* row 0 is never odd */
-			a -= z - Z_COORD(vcur, i - width + 1);
-			if (i / width + 1 < height)
-				a -= z - Z_COORD(vcur, i + width + 1);
-		} else {
-			if (i > width)
-				a -= z - Z_COORD(vcur, i - width);
-			if (i / width + 1 < height)
-				a -= z - Z_COORD(vcur, i + width);
-		}
-	}
-	if (!(i % width || rand() % 128))
-		return 2.0f;
-	else
-		return p * a - k * z - f * (z - Z_COORD(vprev, i));
-}
-
-void
-move(const size_t width, const size_t height, float vcur[], float vprev[])
-{
-	const size_t n = numvert(width, height);
-	const float h = 0.1;
-	size_t v;
-	float temp[3 * n];
-	memcpy(temp, vcur, 3 * n * sizeof(float));
-	for (v = 0; v < n; ++v)
-		Z_COORD(vcur, v) = 2 * Z_COORD(vcur, v) - Z_COORD(vprev, v) + force(width, height, temp, vprev, v) * h * h;
-	memcpy(vprev, temp, 3 * n * sizeof(float));
-}
-
-/*
- * NOTE: This is the dirtiest function, and the only one using Xlib too.
- * Coincidence? Definitely not.
- */
+/* SIGUSR1, only caught with -p */
 void
-setbkg(Display *const disp, Screen *const scr,
-       char buffer[3 * scr->width * scr->height])
+profsig(int param)
 {
-	const int depth = DefaultDepth(disp, DefaultScreen(disp));
-	Window root = RootWindow(disp, DefaultScreen(disp));
-	XImage *img;
-	Pixmap pix;
-	XGCValues gcval;
-	GC gc;
-	img = XCreateImage(disp, CopyFromParent, depth, ZPixmap, 0,
-	                   buffer, scr->width, scr->height, 32, 0);
-	pix = XCreatePixmap(disp, root, scr->width, scr->height, depth); 
-	gc = XCreateGC(disp, pix, 0, &gcval);
-	XPutImage(disp, pix, gc, img, 0, 0, 0, 0, scr->width, scr->height);
-	XSetWindowBackgroundPixmap(disp, root, pix);
-	XFreeGC(disp, gc);
-	XFreePixmap(disp, pix);
-	/* FIXME: XDestroyImage is unlinkable and causes SIGABRT. Fuck Xlib! */
-	/* XDestroyImage(img); */
-	XClearWindow(disp, root);
-	XFlush(disp);
+	sigprof = 1;
 }
 
 int
@@ -308,7 +282,7 @@ mkshader(GLuint *const s, const GLint type, char *const inflog,
 		        name, inflog);
 		return 0;
 	}
-	printf("%s compilation succeeded.\n", name);
+	fprintf(stderr, "%s compilation succeeded.\n", name);
 	return 1;
 }
 
@@ -327,28 +301,33 @@ int
 mkpgr(GLuint *const sp, const GLchar *vs, const GLchar *gs, const GLchar *fs)
 {
 	GLchar inflog[LOG_MAX_LENGTH];
-	GLuint v, g, f;
-	GLint success;
+	GLuint v, g = 0, f, block;
+	GLint success = 0;
 	if (!mkshader(&v, GL_VERTEX_SHADER, inflog, &vs, "vertex shader"))
 		goto errv;
-	if (!mkshader(&g, GL_GEOMETRY_SHADER, inflog, &gs, "geometry shader"))
+	/* no geometry stage unless asked for */
+	if (gs && !mkshader(&g, GL_GEOMETRY_SHADER, inflog, &gs, "geometry shader"))
 		goto errg;
 	if (!mkshader(&f, GL_FRAGMENT_SHADER, inflog, &fs, "fragment shader"))
 		goto errf;
 	*sp = glCreateProgram();
 	glAttachShader(*sp, v);
-	glAttachShader(*sp, g);
+	if (gs)
+		glAttachShader(*sp, g);
 	glAttachShader(*sp, f);
 	glLinkProgram(*sp);
 	glGetProgramiv(*sp, GL_LINK_STATUS, &success);
 	if (!success) {
 		glGetProgramInfoLog(*sp, LOG_MAX_LENGTH, NULL, inflog);
 		fprintf(stderr, "Error: shader program linking failed.\n%s\n", inflog);
+	} else if ((block = glGetUniformBlockIndex(*sp, "frame")) != GL_INVALID_INDEX) {
+		glUniformBlockBinding(*sp, block, FRAME_BINDING);
 	}
 	errf:
 	glDeleteShader(f);
 	errg:
-	glDeleteShader(g);
+	if (gs)
+		glDeleteShader(g);
 	errv:
 	glDeleteShader(v);
 	return success;
@@ -364,7 +343,7 @@ mkcontext(Display *const disp, const int msaa, GLXContext *const retcontext)
 		GLX_GREEN_SIZE, 1,
 		GLX_BLUE_SIZE, 1,
 		GLX_DEPTH_SIZE, 1,
-		GLX_SAMPLE_BUFFERS, 1,
+		GLX_SAMPLE_BUFFERS, msaa > 1,
 		GLX_SAMPLES, msaa,
 		None
 	};
@@ -420,126 +399,1709 @@ mkcontext(Display *const disp, const int msaa, GLXContext *const retcontext)
 	return 1;
 }
 
+/* how long a hidden root window waits for X events before checking signals */
+#define HIDDEN_POLL_MS 250
+
+/* the root window, and whether any of it shows */
+struct xroot {
+	Display *disp;
+	Window root;
+	int width, height;
+	int visible, dirty;
+	/* first RandR event, -1 without RandR 1.3 */
+	int rrevent;
+};
+
+struct glx {
+	struct xroot x;
+	GLXContext context;
+};
+
+void
+glxpresent(struct output *const o)
+{
+	struct glx *const g = o->data;
+	glXSwapBuffers(g->x.disp, g->x.root);
+}
+
+void
+glxclose(struct output *const o)
+{
+	struct glx *const g = o->data;
+	glXMakeCurrent(g->x.disp, None, NULL);
+	glXDestroyContext(g->x.disp, g->context);
+	free(g);
+}
+
 int
-graphics(const size_t wwidth, const size_t wheight,
-         Display *const disp, Screen *const scr, const float t)
+ignoreerror(Display *disp, XErrorEvent *ev)
 {
-	const size_t numv = numvert(wwidth, wheight);
-	const size_t numi = numind(wwidth, wheight);
-	struct tm *localt;
-	GLfloat vcur[3 * numv];
-	GLfloat vprev[3 * numv];
-	GLuint ind[numi];
-	GLfloat view[16];
-	GLfloat projection[16];
-	GLuint sp;
-	GLuint vbo, vao, ebo;
-	Window root = RootWindow(disp, DefaultScreen(disp));
-	GLXContext context;
+	return 0;
+}
 
-	/* OpenGL context */
-	if (!mkcontext(disp, 8, &context))
-		return EXIT_FAILURE;
-	if (!glXMakeCurrent(disp, root, context)) {
+/*
+ * Whether any pixel of the root window shows, going through its mapped
+ * children from the top of the stack down. Windows can vanish while this
+ * runs, so X errors are ignored for the duration.
+ */
+int
+rootvisible(Display *const disp, const Window root,
+            const int width, const int height)
+{
+	XRectangle rect = { 0, 0, width, height };
+	int (*handler)(Display *, XErrorEvent *);
+	Window rret, pret, *children;
+	XWindowAttributes attr;
+	Region left, win;
+	unsigned int n, i;
+	int visible;
+	left = XCreateRegion();
+	XUnionRectWithRegion(&rect, left, left);
+	handler = XSetErrorHandler(ignoreerror);
+	if (!XQueryTree(disp, root, &rret, &pret, &children, &n))
+		n = 0;
+	for (i = n; i-- && !XEmptyRegion(left);) {
+		if (!XGetWindowAttributes(disp, children[i], &attr)
+		    || attr.map_state != IsViewable || attr.class == InputOnly)
+			continue;
+		rect.x = attr.x;
+		rect.y = attr.y;
+		rect.width = attr.width + 2 * attr.border_width;
+		rect.height = attr.height + 2 * attr.border_width;
+		win = XCreateRegion();
+		XUnionRectWithRegion(&rect, win, win);
+		XSubtractRegion(left, win, left);
+		XDestroyRegion(win);
+	}
+	XSync(disp, False);
+	XSetErrorHandler(handler);
+	if (n)
+		XFree(children);
+	visible = !XEmptyRegion(left);
+	XDestroyRegion(left);
+	return visible;
+}
+
+void
+rootinit(struct xroot *const x, Display *const disp)
+{
+	Screen *const scr = ScreenOfDisplay(disp, DefaultScreen(disp));
+	int rrerror, major, minor;
+	x->disp = disp;
+	x->root = RootWindow(disp, DefaultScreen(disp));
+	x->width = scr->width;
+	x->height = scr->height;
+	x->visible = 1;
+	x->dirty = 1;
+	x->rrevent = -1;
+	XSelectInput(disp, x->root, SubstructureNotifyMask);
+	if (XRRQueryExtension(disp, &x->rrevent, &rrerror)
+	    && XRRQueryVersion(disp, &major, &minor)
+	    && (major > 1 || (major == 1 && minor >= 3))) {
+		XRRSelectInput(disp, x->root, RRScreenChangeNotifyMask
+		                              | RRCrtcChangeNotifyMask);
+	} else {
+		x->rrevent = -1;
+		fputs("Warning: no RandR 1.3, drawing one monitor.\n", stderr);
+	}
+}
+
+/*
+ * One monitor per enabled CRTC, clipped to the output, mirrors counted once.
+ * Without RandR, or with nothing enabled, the whole output is one monitor.
+ */
+void
+rootmonitors(struct xroot *const x, struct output *const o)
+{
+	XRRScreenResources *res = NULL;
+	XRRCrtcInfo *crtc;
+	struct monitor m;
+	int i, j, n = 0, x1, y1;
+	if (x->rrevent >= 0)
+		res = XRRGetScreenResourcesCurrent(x->disp, x->root);
+	for (i = 0; res && i < res->ncrtc && n < OUTPUT_MAX_MONITORS; ++i) {
+		if (!(crtc = XRRGetCrtcInfo(x->disp, res, res->crtcs[i])))
+			continue;
+		m.x = crtc->x > 0 ? crtc->x : 0;
+		m.y = crtc->y > 0 ? crtc->y : 0;
+		x1 = crtc->x + (int) crtc->width;
+		y1 = crtc->y + (int) crtc->height;
+		m.width = (x1 < o->width ? x1 : o->width) - m.x;
+		m.height = (y1 < o->height ? y1 : o->height) - m.y;
+		j = crtc->mode != None && m.width > 0 && m.height > 0;
+		XRRFreeCrtcInfo(crtc);
+		if (!j)
+			continue;
+		for (j = 0; j < n && memcmp(&o->monitors[j], &m, sizeof(m)); ++j)
+			;
+		if (j == n)
+			o->monitors[n++] = m;
+	}
+	if (res)
+		XRRFreeScreenResources(res);
+	if (!n) {
+		o->monitors[0].x = o->monitors[0].y = 0;
+		o->monitors[0].width = o->width;
+		o->monitors[0].height = o->height;
+		n = 1;
+	}
+	o->nmonitors = n;
+	++o->layout;
+}
+
+/*
+ * Any change to the top-level windows means computing visibility again. Tells
+ * whether the monitors changed, in which case the size may have too.
+ */
+int
+rootevent(struct xroot *const x, XEvent *const ev)
+{
+	switch (ev->type) {
+	case CirculateNotify:
+	case ConfigureNotify:
+	case CreateNotify:
+	case DestroyNotify:
+	case MapNotify:
+	case ReparentNotify:
+	case UnmapNotify:
+		x->dirty = 1;
+		return 0;
+	}
+	if (x->rrevent < 0)
+		return 0;
+	if (ev->type == x->rrevent + RRScreenChangeNotify) {
+		XRRUpdateConfiguration(ev);
+		x->width = DisplayWidth(x->disp, DefaultScreen(x->disp));
+		x->height = DisplayHeight(x->disp, DefaultScreen(x->disp));
+		x->dirty = 1;
+		return 1;
+	}
+	return ev->type == x->rrevent + RRNotify;
+}
+
+/*
+ * Call once the pending X events are through rootevent(). A hidden root
+ * window waits a little for events if asked to.
+ */
+int
+rootshows(struct xroot *const x, const int block)
+{
+	struct pollfd fd;
+	if (x->dirty) {
+		x->visible = rootvisible(x->disp, x->root, x->width, x->height);
+		x->dirty = 0;
+	}
+	if (!x->visible && block) {
+		fd.fd = ConnectionNumber(x->disp);
+		fd.events = POLLIN;
+		poll(&fd, 1, HIDDEN_POLL_MS);
+	}
+	return x->visible;
+}
+
+int
+glxvisible(struct output *const o, const int block)
+{
+	struct glx *const g = o->data;
+	int relayout = 0;
+	XEvent ev;
+	while (XPending(g->x.disp)) {
+		XNextEvent(g->x.disp, &ev);
+		relayout |= rootevent(&g->x, &ev);
+	}
+	/* the root window's framebuffer follows the screen size */
+	if (relayout) {
+		o->width = g->x.width;
+		o->height = g->x.height;
+		rootmonitors(&g->x, o);
+	}
+	return rootshows(&g->x, block);
+}
+
+int
+hasext(const char *const exts, const char *const name)
+{
+	const size_t n = strlen(name);
+	const char *e;
+	for (e = exts; (e = strstr(e, name)); e += n) {
+		if ((e == exts || e[-1] == ' ') && (e[n] == ' ' || !e[n]))
+			return 1;
+	}
+	return 0;
+}
+
+/* swaps on every vertical blank, through whichever extension is there */
+int
+setvsync(Display *const disp, const GLXDrawable drawable)
+{
+	const char *const exts = glXQueryExtensionsString(disp, DefaultScreen(disp));
+	PFNGLXSWAPINTERVALEXTPROC swapintervalext;
+	glXSwapIntervalMESAProc swapintervalmesa;
+	if (hasext(exts, "GLX_EXT_swap_control")) {
+		swapintervalext = (PFNGLXSWAPINTERVALEXTPROC) glXGetProcAddressARB((const GLubyte*) "glXSwapIntervalEXT");
+		if (swapintervalext) {
+			swapintervalext(disp, drawable, 1);
+			return 1;
+		}
+	}
+	if (hasext(exts, "GLX_MESA_swap_control")) {
+		swapintervalmesa = (glXSwapIntervalMESAProc) glXGetProcAddressARB((const GLubyte*) "glXSwapIntervalMESA");
+		if (swapintervalmesa)
+			return !swapintervalmesa(1);
+	}
+	return 0;
+}
+
+/* draws straight into the root window */
+int
+mkglxout(struct output *const o, Display *const disp, const int msaa,
+         const int vsync)
+{
+	struct glx *g;
+	if (!(g = malloc(sizeof(*g)))) {
+		fputs("Error: failed to allocate the X output.\n", stderr);
+		return 0;
+	}
+	rootinit(&g->x, disp);
+	if (!mkcontext(disp, msaa, &g->context))
+		goto errx;
+	if (!glXMakeCurrent(disp, g->x.root, g->context)) {
 		fputs("Error: failed to make root current window.\n", stderr);
-		return EXIT_FAILURE;
+		goto errcontext;
 	}
 	glewExperimental = GL_TRUE;
 	if (glewInit() != GLEW_OK) {
 		fputs("Failed to initialize GLEW.\n", stderr);
-		goto errcontext;
+		goto errcurrent;
 	}
+	if (vsync && !setvsync(disp, g->x.root))
+		fputs("Warning: no GLX swap control, vsync is off.\n", stderr);
+	o->width = g->x.width;
+	o->height = g->x.height;
+	o->layout = 0;
+	rootmonitors(&g->x, o);
+	o->fbo = 0;
+	o->present = glxpresent;
+	o->visible = glxvisible;
+	o->close = glxclose;
+	o->data = g;
+	return 1;
 
-	/* vertices and tris */
-	initvert(wwidth, wheight, vcur);
-	memcpy(vprev, vcur, 3 * numv * sizeof(GLfloat));
-	//initvert(wwidth, wheight, vprev);
-	initind(wwidth, wheight, ind);
+	errcurrent:
+	glXMakeCurrent(disp, None, NULL);
+	errcontext:
+	glXDestroyContext(disp, g->context);
+	errx:
+	free(g);
+	return 0;
+}
 
-	glViewport(0, 0, scr->width, scr->height);
-	//glEnable(GL_DEPTH_TEST);
-	//glEnable(GL_MULTISAMPLE);
+/*
+ * Draws offscreen through EGL and copies every frame into a pixmap that stays
+ * the root window's background, which compositors show too. The copy goes
+ * through a shared memory XImage when the server has MIT-SHM, so frames never
+ * travel over the socket, and through XPutImage otherwise.
+ */
+struct xbkg {
+	struct xroot x;
+	struct output gl;
+	Pixmap pix;
+	GC gc;
+	XImage *img;
+	XShmSegmentInfo shm;
+	int useshm, completion, pending;
+	GLuint fbo, rbo;
+	struct readback rb;
+	/* gets every frame when baking a loop */
+	struct loopw *bake;
+};
 
-	if (!mkpgr(&sp, vshadersrc, gshadersrc, fshadersrc))
-		goto errcontext;
+static int xfailed;
+
+int
+catcherror(Display *disp, XErrorEvent *ev)
+{
+	xfailed = 1;
+	return 0;
+}
+
+/* names the pixmap where compositors and pseudo-transparent programs look */
+void
+setrootpmap(struct xbkg *const b, const Pixmap pix)
+{
+	static const char *const names[] = { "_XROOTPMAP_ID", "ESETROOT_PMAP_ID" };
+	Atom atom;
+	size_t i;
+	for (i = 0; i < sizeof(names) / sizeof(*names); ++i) {
+		atom = XInternAtom(b->x.disp, names[i], False);
+		if (pix)
+			XChangeProperty(b->x.disp, b->x.root, atom, XA_PIXMAP, 32,
+			                PropModeReplace, (unsigned char *) &pix, 1);
+		else
+			XDeleteProperty(b->x.disp, b->x.root, atom);
+	}
+}
+
+Bool
+isshmdone(Display *disp, XEvent *ev, XPointer arg)
+{
+	return ev->type == ((struct xbkg *) arg)->completion;
+}
+
+/* the server reads the segment after XShmPutImage() returns, wait for that */
+void
+shmwait(struct xbkg *const b)
+{
+	XEvent ev;
+	if (b->pending)
+		XIfEvent(b->x.disp, &ev, isshmdone, (XPointer) b);
+	b->pending = 0;
+}
+
+/*
+ * A shared memory image of the whole root window. The segment is marked for
+ * removal as soon as both ends have it, so it cannot outlive the program.
+ */
+int
+mkshmimage(struct xbkg *const b, Visual *const vis, const int depth)
+{
+	int (*handler)(Display *, XErrorEvent *);
+	if (!XShmQueryExtension(b->x.disp))
+		return 0;
+	b->img = XShmCreateImage(b->x.disp, vis, depth, ZPixmap, NULL, &b->shm,
+	                         b->x.width, b->x.height);
+	if (!b->img)
+		return 0;
+	b->shm.shmid = shmget(IPC_PRIVATE, b->img->bytes_per_line * b->img->height,
+	                      IPC_CREAT | 0600);
+	if (b->shm.shmid < 0)
+		goto errimg;
+	b->shm.shmaddr = b->img->data = shmat(b->shm.shmid, NULL, 0);
+	if (b->shm.shmaddr == (char *) -1)
+		goto errid;
+	b->shm.readOnly = True;
+	/* a remote server fails to attach, which only shows as an X error */
+	xfailed = 0;
+	handler = XSetErrorHandler(catcherror);
+	XShmAttach(b->x.disp, &b->shm);
+	XSync(b->x.disp, False);
+	XSetErrorHandler(handler);
+	shmctl(b->shm.shmid, IPC_RMID, NULL);
+	if (xfailed)
+		goto erraddr;
+	b->completion = XShmGetEventBase(b->x.disp) + ShmCompletion;
+	return 1;
+
+	erraddr:
+	shmdt(b->shm.shmaddr);
+	goto errimg;
+	errid:
+	shmctl(b->shm.shmid, IPC_RMID, NULL);
+	errimg:
+	/* XDestroyImage() would free() the segment */
+	b->img->data = NULL;
+	XDestroyImage(b->img);
+	b->img = NULL;
+	return 0;
+}
+
+/* hands the image to the X server and has the root window show it */
+void
+bkgput(struct xbkg *const b)
+{
+	const int w = b->img->width, h = b->img->height;
+	if (b->useshm) {
+		XShmPutImage(b->x.disp, b->pix, b->gc, b->img, 0, 0, 0, 0, w, h, True);
+		b->pending = 1;
+	} else {
+		XPutImage(b->x.disp, b->pix, b->gc, b->img, 0, 0, 0, 0, w, h);
+	}
+	XClearWindow(b->x.disp, b->x.root);
+	XFlush(b->x.disp);
+}
+
+/*
+ * Queues this frame's readback and hands the newest one already read to the
+ * X server, usually the previous frame, so nothing waits on the GPU. A bake
+ * skips no frame and takes each one a frame late, waiting if it has to.
+ */
+void
+bkgpresent(struct output *const o)
+{
+	struct xbkg *const b = o->data;
+	const int w = o->width, h = o->height;
+	const void *px;
+	GLint draw;
+	b->gl.present(&b->gl);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+	/* X images go top down */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, b->gl.fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, b->fbo);
+	glBlitFramebuffer(0, 0, w, h, 0, h, w, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, b->fbo);
+	readbackpush(&b->rb);
+	glBindFramebuffer(GL_FRAMEBUFFER, draw);
+	if (b->bake) {
+		if (b->rb.count < 2 || !(px = readbackmap(&b->rb, 1)))
+			return;
+	} else {
+		readbackskip(&b->rb);
+		if (!(px = readbackmap(&b->rb, 0)))
+			return;
+	}
+	shmwait(b);
+	memcpy(b->img->data, px, b->rb.size);
+	/* a failed bake stops the drawing that only feeds it */
+	if (b->bake && !loopadd(b->bake, px, b->rb.stride))
+		sigclose = 1;
+	readbackunmap(&b->rb);
+	bkgput(b);
+}
+
+/* goes through the pending X events, returns whether the monitors changed */
+int
+bkgevents(struct xbkg *const b)
+{
+	int relayout = 0;
+	XEvent ev;
+	while (XPending(b->x.disp)) {
+		XNextEvent(b->x.disp, &ev);
+		if (b->useshm && ev.type == b->completion)
+			b->pending = 0;
+		else
+			relayout |= rootevent(&b->x, &ev);
+	}
+	return relayout;
+}
+
+int
+bkgvisible(struct output *const o, const int block)
+{
+	struct xbkg *const b = o->data;
+	/* the pixmap keeps its size, monitors past it go unseen */
+	if (bkgevents(b))
+		rootmonitors(&b->x, o);
+	return rootshows(&b->x, block);
+}
+
+/* the background keeps the last frame, but nothing names the pixmap anymore */
+void
+freexbkg(struct xbkg *const b)
+{
+	shmwait(b);
+	setrootpmap(b, None);
+	if (b->useshm) {
+		XShmDetach(b->x.disp, &b->shm);
+		XSync(b->x.disp, False);
+		shmdt(b->shm.shmaddr);
+		b->img->data = NULL;
+	}
+	XDestroyImage(b->img);
+	XFreeGC(b->x.disp, b->gc);
+	XFreePixmap(b->x.disp, b->pix);
+	XFlush(b->x.disp);
+}
+
+/* the frames still in flight go to the bake first */
+void
+bkgclose(struct output *const o)
+{
+	struct xbkg *const b = o->data;
+	const void *px;
+	while (b->bake && (px = readbackmap(&b->rb, 1))) {
+		loopadd(b->bake, px, b->rb.stride);
+		readbackunmap(&b->rb);
+	}
+	freexbkg(b);
+	freereadback(&b->rb);
+	glDeleteFramebuffers(1, &b->fbo);
+	glDeleteRenderbuffers(1, &b->rbo);
+	b->gl.close(&b->gl);
+	free(b);
+}
+
+/*
+ * The X side alone: a BGRA image of the whole root window and the pixmap it
+ * goes to, named as the background.
+ */
+int
+mkxbkg(struct xbkg *const b, Display *const disp)
+{
+	const int scr = DefaultScreen(disp), depth = DefaultDepth(disp, scr);
+	Visual *const vis = DefaultVisual(disp, scr);
+	XGCValues gcval;
+	rootinit(&b->x, disp);
+	b->useshm = mkshmimage(b, vis, depth);
+	if (!b->useshm) {
+		fputs("Warning: no MIT-SHM, frames go through the X socket.\n", stderr);
+		b->img = XCreateImage(disp, vis, depth, ZPixmap, 0, NULL,
+		                      b->x.width, b->x.height, 32, 0);
+		if (b->img)
+			b->img->data = malloc(b->img->bytes_per_line * b->img->height);
+		if (!b->img || !b->img->data) {
+			fputs("Error: failed to allocate the background image.\n", stderr);
+			goto errimg;
+		}
+	}
+	/* the frames are read back as BGRA bytes */
+	if (b->img->bits_per_pixel != 32 || b->img->byte_order != LSBFirst
+	    || b->img->red_mask != 0xff0000 || b->img->green_mask != 0xff00
+	    || b->img->blue_mask != 0xff) {
+		fputs("Error: the root window's visual is not BGRA.\n", stderr);
+		goto errimg;
+	}
+	b->pix = XCreatePixmap(disp, b->x.root, b->x.width, b->x.height, depth);
+	b->gc = XCreateGC(disp, b->pix, 0, &gcval);
+	XSetWindowBackgroundPixmap(disp, b->x.root, b->pix);
+	setrootpmap(b, b->pix);
+	return 1;
+
+	errimg:
+	if (b->img) {
+		if (b->useshm) {
+			XShmDetach(disp, &b->shm);
+			XSync(disp, False);
+			shmdt(b->shm.shmaddr);
+			b->img->data = NULL;
+		}
+		XDestroyImage(b->img);
+	}
+	return 0;
+}
+
+/* with bake set, every frame drawn also goes to it */
+int
+mkbkgout(struct output *const o, Display *const disp, const int msaa,
+         struct loopw *const bake)
+{
+	struct xbkg *b;
+	GLint draw;
+	if (!(b = calloc(1, sizeof(*b)))) {
+		fputs("Error: failed to allocate the X output.\n", stderr);
+		return 0;
+	}
+	if (!mkxbkg(b, disp))
+		goto errb;
+	if (!mkeglout(&b->gl, b->x.width, b->x.height, msaa))
+		goto errx;
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+	glGenRenderbuffers(1, &b->rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, b->rbo);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, b->x.width, b->x.height);
+	glGenFramebuffers(1, &b->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, b->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+	                          GL_RENDERBUFFER, b->rbo);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fputs("Error: incomplete readback framebuffer.\n", stderr);
+		goto errfbo;
+	}
+	if (!mkreadback(&b->rb, b->x.width, b->x.height, b->img->bytes_per_line)) {
+		fputs("Error: failed to make the readback buffers.\n", stderr);
+		freereadback(&b->rb);
+		goto errfbo;
+	}
+	/* what to draw into stays EGL's */
+	glBindFramebuffer(GL_FRAMEBUFFER, draw);
+
+	b->bake = bake;
+	o->width = b->x.width;
+	o->height = b->x.height;
+	o->layout = 0;
+	rootmonitors(&b->x, o);
+	o->fbo = b->gl.fbo;
+	o->present = bkgpresent;
+	o->visible = bkgvisible;
+	o->close = bkgclose;
+	o->data = b;
+	return 1;
+
+	errfbo:
+	glDeleteFramebuffers(1, &b->fbo);
+	glDeleteRenderbuffers(1, &b->rbo);
+	b->gl.close(&b->gl);
+	errx:
+	freexbkg(b);
+	errb:
+	free(b);
+	return 0;
+}
+
+/*
+ * -D: the headless output, with every frame read back asynchronously and
+ * written out a frame late, so that the GPU is a frame ahead of the writes.
+ */
+struct dumpout {
+	struct output gl;
+	struct readback rb;
+	struct dump *d;
+};
 
-	glGenVertexArrays(1, &vao);
-	glGenBuffers(1, &vbo);
-	glGenBuffers(1, &ebo);
+void
+dumppresent(struct output *const o)
+{
+	struct dumpout *const d = o->data;
+	const void *px;
+	GLint draw;
+	d->gl.present(&d->gl);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, d->gl.fbo);
+	readbackpush(&d->rb);
+	glBindFramebuffer(GL_FRAMEBUFFER, draw);
+	if (d->rb.count < 2 || !(px = readbackmap(&d->rb, 1)))
+		return;
+	/* nobody reads the frames anymore, stop drawing them */
+	if (!dumpframe(d->d, px))
+		sigclose = 1;
+	readbackunmap(&d->rb);
+}
 
-	/* web */
+/* the frame still in flight goes out first */
+void
+dumpclose(struct output *const o)
+{
+	struct dumpout *const d = o->data;
+	const void *px;
+	while ((px = readbackmap(&d->rb, 1))) {
+		dumpframe(d->d, px);
+		readbackunmap(&d->rb);
+	}
+	freereadback(&d->rb);
+	d->gl.close(&d->gl);
+	free(d);
+}
+
+int
+mkdumpout(struct output *const o, const int width, const int height,
+          const int msaa, struct dump *const dump)
+{
+	struct dumpout *d;
+	if (!(d = calloc(1, sizeof(*d)))) {
+		fputs("Error: failed to allocate the dump output.\n", stderr);
+		return 0;
+	}
+	if (!mkeglout(&d->gl, width, height, msaa))
+		goto errd;
+	if (!mkreadback(&d->rb, width, height, (size_t) width * 4)) {
+		fputs("Error: failed to make the readback buffers.\n", stderr);
+		freereadback(&d->rb);
+		d->gl.close(&d->gl);
+		goto errd;
+	}
+	d->d = dump;
+	*o = d->gl;
+	o->present = dumppresent;
+	o->visible = NULL;
+	o->close = dumpclose;
+	o->data = d;
+	return 1;
+
+	errd:
+	free(d);
+	return 0;
+}
+
+void
+sethmap(const GLuint sp, const size_t mwidth, const size_t factor,
+        const GLfloat side, const GLfloat dy, const GLfloat offy)
+{
+	glUseProgram(sp);
+	glUniform1i(glGetUniformLocation(sp, "heightmap"), 0);
+	glUniform1i(glGetUniformLocation(sp, "meshwidth"), mwidth);
+	glUniform1i(glGetUniformLocation(sp, "factor"), factor);
+	glUniform3f(glGetUniformLocation(sp, "lattice"), side, dy, offy);
+}
+
+void
+drawweb(const GLuint sp, const GLuint vao, const size_t numi,
+        const GLenum type)
+{
+	glUseProgram(sp);
 	glBindVertexArray(vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, 3 * numv * sizeof(GLfloat), vcur, GL_STREAM_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numi * sizeof(GLuint), ind, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) 0);
-	glEnableVertexAttribArray(0);
-
-	matproj(projection, 0.75f, 0.75f * 9.0f / 16.0f, 0.01f, 4.0f);
-	signal(SIGTERM, kill);
-	while (!sigclose) {
-		glClearColor(0.1f, 0.0f, 0.0f, 1.0f);
+	glPrimitiveRestartIndex(restartind(type));
+	glDrawElements(GL_TRIANGLE_STRIP, numi, type, 0);
+	glBindVertexArray(0);
+}
+
+/* fits the scene to the monitor's aspect ratio */
+void
+monproj(GLfloat mat[16], const struct monitor *const m)
+{
+	matproj(mat, 0.75f, 0.75f * m->height / m->width, 0.01f, 4.0f);
+}
+
+/* in GL's window coordinates, where y goes up */
+void
+setmonitor(const struct output *const o, const struct monitor *const m)
+{
+	const int y = o->height - m->y - m->height;
+	glViewport(m->x, y, m->width, m->height);
+	glScissor(m->x, y, m->width, m->height);
+}
+
+/* clears what the monitors show, and not the gaps in between */
+void
+clearmonitors(const struct output *const o)
+{
+	int i;
+	glClearColor(0.1f, 0.0f, 0.0f, 1.0f);
+	glEnable(GL_SCISSOR_TEST);
+	for (i = 0; i < o->nmonitors; ++i) {
+		setmonitor(o, &o->monitors[i]);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+	glDisable(GL_SCISSOR_TEST);
+}
+
+/*
+ * Draws the web once per monitor. A single monitor keeps the projection
+ * already in the frame block unless told it is stale.
+ */
+void
+drawmonitors(const struct output *const o, const GLuint sp, const GLuint vao,
+             const size_t numi, const GLenum type, const GLuint ubo,
+             const int stale)
+{
+	GLfloat proj[16];
+	int i;
+	for (i = 0; i < o->nmonitors; ++i) {
+		setmonitor(o, &o->monitors[i]);
+		if (stale || o->nmonitors > 1) {
+			monproj(proj, &o->monitors[i]);
+			glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+			glBufferSubData(GL_UNIFORM_BUFFER, offsetof(struct frame, projection),
+			                sizeof(proj), proj);
+		}
+		drawweb(sp, vao, numi, type);
+	}
+}
+
+/* pixels of a and b with a channel further apart than CHECK_TOLERANCE */
+size_t
+pixdiff(const unsigned char *a, const unsigned char *b, const size_t n,
+        int *const maxdiff)
+{
+	size_t i, count = 0;
+	int d, over;
+	for (i = 0; i < n; ++i) {
+		over = 0;
+		for (int k = 0; k < 4; ++k) {
+			d = abs(a[4 * i + k] - b[4 * i + k]);
+			if (d > *maxdiff)
+				*maxdiff = d;
+			if (d > CHECK_TOLERANCE)
+				over = 1;
+		}
+		count += over;
+	}
+	return count;
+}
+
+int
+dumpprof(struct prof *const p, const char *const path)
+{
+	FILE *const f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "Error: cannot write the profile to %s.\n", path);
+		return 0;
+	}
+	profdump(p, f);
+	fclose(f);
+	fprintf(stderr, "Profile written to %s.\n", path);
+	return 1;
+}
+
+/* largest difference between two height fields */
+double
+maxdist(const float a[], const float b[], const size_t n)
+{
+	double d = 0.0;
+	size_t i;
+	for (i = 0; i < n; ++i)
+		d = fmax(d, fabs(a[i] - b[i]));
+	return d;
+}
+
+void
+readout(const struct output *const o, unsigned char *const px)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, o->fbo);
+	glReadPixels(0, 0, o->width, o->height, GL_RGBA, GL_UNSIGNED_BYTE, px);
+}
+
+/* everything sized by the grid: the wave, what steps it and what draws it */
+struct web {
+	size_t wwidth, wheight, mwidth, mheight, k;
+	size_t numv, numi, zsize;
+	GLenum itype;
+	struct arena arena;
+	GLfloat *xy;
+	float *zstage, *snaps;
+	void *ind;
+	unsigned char *kicks;
+	struct wave w;
+	struct pool pool;
+	struct sim sim;
+	int running;
+	struct gpusim gsim;
+	struct ring ring;
+	GLuint vao, ebo, xyvbo, hmap;
+	const float *last;
+	/* what the profiler has seen of the simulation thread so far */
+	unsigned long long movens;
+	unsigned long moves;
+};
+
+/* the grid with 2^shift times fewer cells each way, as long as there is one */
+size_t
+shrink(const size_t n, const int shift)
+{
+	const size_t m = ((n - 1) >> shift) + 1;
+	return m < 2 ? 2 : m;
+}
+
+/* a base vertex would shift XY too, so the z pointer moves instead */
+void
+zpointer(const struct web *const web, const GLintptr off)
+{
+	glBindVertexArray(web->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, web->ring.vbo);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void *) off);
+	glBindVertexArray(0);
+}
+
+/*
+ * Starts the simulation thread. With a mapped vertex ring, its three slots
+ * are the thread's snapshots, so steps are published straight into what
+ * gets drawn.
+ */
+int
+webstart(struct web *const web)
+{
+	float *const ring = ringidle(&web->ring);
+	web->running = mksim(&web->sim, &web->pool, ring ? ring : web->snaps,
+	                     1.0 / STEP_RATE);
+	if (web->running && ring) {
+		web->last = simlatest(&web->sim);
+		zpointer(web, ringuse(&web->ring, web->last));
+	}
+	return web->running;
+}
+
+/*
+ * The simulation thread's latest snapshot. Drawing from the ring, the slot
+ * drawn so far only goes back to the thread once the GPU is through with it.
+ */
+const float *
+weblatest(struct web *const web)
+{
+	if (!web->ring.map)
+		return simlatest(&web->sim);
+	if (!simfresh(&web->sim))
+		return web->last;
+	ringwait(&web->ring, web->last);
+	return simlatest(&web->sim);
+}
+
+/*
+ * Sets up a grid and starts stepping it. The heights of from carry over if
+ * not NULL, otherwise the wave starts flat. The web must stay where it is,
+ * the simulation threads point into it.
+ */
+int
+mkweb(struct web *const web, const size_t wwidth, const size_t wheight,
+      const struct conf *const c, const GLuint sp, const GLuint refsp,
+      const GLuint simsp, const struct wave *const from)
+{
+	size_t isize, i;
+	GLfloat side, dy, offy;
+	web->wwidth = wwidth;
+	web->wheight = wheight;
+	/* the mesh is only denser than the grid when drawn from a heightmap */
+	web->k = c->upsample ? c->upsample : 1;
+	web->mwidth = (wwidth - 1) * web->k + 1;
+	web->mheight = (wheight - 1) * web->k + 1;
+	web->numv = numvert(wwidth, wheight);
+	web->numi = numstrip(web->mwidth, web->mheight);
+	web->itype = indtype(web->mwidth, web->mheight);
+	web->zsize = web->numv * sizeof(float);
+	web->running = 0;
+	web->vao = web->ebo = web->xyvbo = web->hmap = 0;
+	web->ring.map = NULL;
+	web->last = NULL;
+	web->movens = 0;
+	web->moves = 0;
+	isize = web->numi * indsize(web->itype);
+
+	/* everything sized by the grid lives in the arena, not on the stack */
+	if (!mkarena(&web->arena, ARENA_SIZE(2 * web->zsize) + ARENA_SIZE(web->zsize)
+	                          + 3 * ARENA_SIZE(web->zsize)
+	                          + ARENA_SIZE(3 * web->zsize) + ARENA_SIZE(isize)
+	                          + ARENA_SIZE(wheight))) {
+		fprintf(stderr, "Error: not enough memory for a %zux%zu grid.\n",
+		        wwidth, wheight);
+		return 0;
+	}
+	web->xy = arenaget(&web->arena, 2 * web->numv * sizeof(GLfloat));
+	web->zstage = arenaget(&web->arena, web->zsize);
+	web->w.width = wwidth;
+	web->w.height = wheight;
+	web->w.cur = arenaget(&web->arena, web->zsize);
+	web->w.prev = arenaget(&web->arena, web->zsize);
+	web->w.next = arenaget(&web->arena, web->zsize);
+	web->w.seed = c->seed;
+	web->w.step = from ? from->step : 0;
+	web->snaps = arenaget(&web->arena, 3 * web->zsize);
+	web->ind = arenaget(&web->arena, isize);
+	web->kicks = arenaget(&web->arena, wheight);
+
+	/* vertices and tris, the heights at rest unless carried over */
+	initxy(wwidth, wheight, web->xy);
+	if (from) {
+		/* prev too, or the wave would lose its speed */
+		resample(from->cur, from->width, from->height, web->w.cur,
+		         wwidth, wheight);
+		resample(from->prev, from->width, from->height, web->w.prev,
+		         wwidth, wheight);
+	} else {
+		for (i = 0; i < web->numv; ++i)
+			web->w.cur[i] = 0.0f;
+		memcpy(web->w.prev, web->w.cur, web->zsize);
+	}
+	memcpy(web->zstage, web->w.cur, web->zsize);
+	initstrip(web->mwidth, web->mheight, web->ind, web->itype);
+	fprintf(stderr, "%zux%zu grid, %zu indices of %zu bytes, ACMR %.3f.\n",
+	        wwidth, wheight, web->numi, indsize(web->itype),
+	        acmr(web->ind, web->numi, web->itype, GL_TRIANGLE_STRIP, 16));
+	if (!mkpool(&web->pool, &web->w, c->threads))
+		fputs("Warning: could not start simulation threads.\n", stderr);
+
+	glGenVertexArrays(1, &web->vao);
+	glGenBuffers(1, &web->ebo);
+	glBindVertexArray(web->vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, web->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, isize, web->ind, GL_STATIC_DRAW);
+	glPrimitiveRestartIndex(restartind(web->itype));
+	if (c->gpu) {
+		/* web and wave: heights never leave the GPU */
+		if (!mkgpusim(&web->gsim, &web->w, simsp, web->kicks,
+		              web->k > 1 ? GL_LINEAR : GL_NEAREST)) {
+			fputs("Error: failed to set up the GPU simulation.\n", stderr);
+			goto errgl;
+		}
+	} else if (c->upsample) {
+		/* web: no attributes, vertices find their own z in the heightmap */
+		glGenTextures(1, &web->hmap);
+		glBindTexture(GL_TEXTURE_2D, web->hmap);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, wwidth, wheight, 0,
+		             GL_RED, GL_FLOAT, web->zstage);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+		                web->k > 1 ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+		                web->k > 1 ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	} else {
+		/* web: XY never change and go up once, only z is streamed */
+		glGenBuffers(1, &web->xyvbo);
+		glBindBuffer(GL_ARRAY_BUFFER, web->xyvbo);
+		glBufferData(GL_ARRAY_BUFFER, 2 * web->numv * sizeof(GLfloat),
+		             web->xy, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void *) 0);
+		glEnableVertexAttribArray(0);
+		if (!mkring(&web->ring, web->zsize, web->zstage)) {
+			fputs("Error: failed to set up the vertex ring.\n", stderr);
+			goto errgl;
+		}
+		glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void *) 0);
+		glEnableVertexAttribArray(1);
+	}
+	glBindVertexArray(0);
+	if (c->upsample) {
+		latticedims(wwidth, wheight, &side, &dy, &offy);
+		sethmap(sp, web->mwidth, web->k, side, dy, offy);
+		if (refsp)
+			sethmap(refsp, web->mwidth, web->k, side, dy, offy);
+	}
+	/* a dump steps the wave itself, in time with its frames */
+	if (!c->gpu && !c->dump && !webstart(web)) {
+		fputs("Error: failed to start the simulation thread.\n", stderr);
+		goto errsim;
+	}
+	return 1;
+
+	errsim:
+	if (!c->upsample)
+		freering(&web->ring);
+	errgl:
+	glDeleteTextures(1, &web->hmap);
+	glDeleteBuffers(1, &web->xyvbo);
+	glDeleteBuffers(1, &web->ebo);
+	glDeleteVertexArrays(1, &web->vao);
+	freepool(&web->pool);
+	freearena(&web->arena);
+	return 0;
+}
+
+/* stops the stepping, with the wave left in w to go on from */
+void
+webstop(struct web *const web, const struct conf *const c)
+{
+	if (c->gpu)
+		gpusave(&web->gsim, &web->w);
+	else if (web->running)
+		freesim(&web->sim);
+	web->running = 0;
+}
+
+void
+freeweb(struct web *const web, const struct conf *const c)
+{
+	webstop(web, c);
+	freepool(&web->pool);
+	if (c->gpu)
+		freegpusim(&web->gsim);
+	else if (!c->upsample)
+		freering(&web->ring);
+	glDeleteTextures(1, &web->hmap);
+	glDeleteBuffers(1, &web->xyvbo);
+	glDeleteBuffers(1, &web->ebo);
+	glDeleteVertexArrays(1, &web->vao);
+	freearena(&web->arena);
+}
 
+/*
+ * What the governor trades away, a little more at each level. The grid loses
+ * cells, the rest are fractions of what was asked for.
+ */
+static const struct level {
+	int shift, samples;
+	float scale, fps;
+} levels[] = {
+	{ 0, MSAA, 1.0f, 1.0f },
+	{ 0, MSAA / 2, 1.0f, 1.0f },
+	{ 0, MSAA / 4, 0.75f, 1.0f },
+	{ 1, MSAA / 4, 0.75f, 1.0f },
+	{ 1, 0, 0.5f, 1.0f },
+	{ 1, 0, 0.5f, 0.5f },
+	{ 2, 0, 0.5f, 0.5f },
+	{ 2, 0, 0.35f, 0.25f },
+};
+
+/* runs until SIGTERM, or for c->frames frames if not 0 */
+int
+graphics(const size_t wwidth, const size_t wheight,
+         struct output *const out, const struct conf *const c)
+{
+	struct tm *localt;
+	struct web webs[2], *web = webs, *next;
+	const float *snap;
+	unsigned long frame = 0;
+	struct pace pace;
+	double start;
+	struct frame fr;
+	GLuint ubo;
+	GLuint sp, refsp = 0;
+	unsigned char *refpx = NULL, *px = NULL;
+	const size_t npx = (size_t) out->width * out->height;
+	size_t ndiff = 0, nchecked = 0;
+	int maxdiff = 0, r = EXIT_SUCCESS;
+	GLuint simsp = 0;
+	/* a dump's frame rate as its Y4M header has it, in frames per 1000 s */
+	const long mfps = c->fps * 1000.0 >= 1.0 ? lround(c->fps * 1000.0) : 1;
+	unsigned long nsteps = 0;
+	unsigned long long due = 0;
+	double nextstep, now, maxerr = 0.0;
+	int n, fresh;
+	struct prof *prof = NULL;
+	int sclear, sdraw, sscale, spresent, supload, swait, smove;
+	struct scale scale, *sc = NULL;
+	struct output *view;
+	unsigned long long dmovens;
+	unsigned long dmoves;
+	/* stale from the start, so that the first frame prints the layout */
+	unsigned long layout = out->layout - 1;
+	int stale;
+	struct gov gov, *g = NULL;
+	const struct level *l;
+	int level = 0, lv;
+	size_t gw, gh;
+
+	//glEnable(GL_DEPTH_TEST);
+	//glEnable(GL_MULTISAMPLE);
+
+	if (!mkpgr(&sp, c->upsample ? vhmapsrc : vshadersrc, NULL, fshadersrc))
+		return EXIT_FAILURE;
+	if (c->check) {
+		if (!mkpgr(&refsp, c->upsample ? vhmapsrc : vshadersrc,
+		           gshadersrc, fgeomsrc))
+			goto errsp;
+		if (!(refpx = malloc(2 * 4 * npx))) {
+			fputs("Error: not enough memory to compare frames.\n", stderr);
+			goto errsp;
+		}
+		px = refpx + 4 * npx;
+	}
+	if (c->gpu && !mkpgr(&simsp, vquadsrc, NULL, fsimsrc)) {
+		fputs("Error: failed to set up the GPU simulation.\n", stderr);
+		goto errsp;
+	}
+	glEnable(GL_PRIMITIVE_RESTART);
+	if (!mkweb(web, wwidth, wheight, c, sp, refsp, simsp, NULL))
+		goto errsp;
+
+	/* camera and light, sent whole once and then from view on */
+	monproj(fr.projection, &out->monitors[0]);
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(fr), &fr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, ubo);
+	if (c->scale) {
+		if (!mkscale(&scale, out, c->scale, MSAA, c->budget))
+			goto errweb;
+		sc = &scale;
+	}
+	if (c->cpushare > 0.0 || c->gpushare > 0.0) {
+		mkgov(&gov, c->cpushare, c->gpushare, sizeof(levels) / sizeof(*levels));
+		g = &gov;
+	}
+	if (c->prof && !(prof = malloc(sizeof(*prof))))
+		fputs("Warning: not enough memory to profile.\n", stderr);
+	if (prof)
+		mkprof(prof);
+	sclear = profsection(prof, "clear");
+	sdraw = profsection(prof, "draw");
+	sscale = sc ? profsection(prof, "upscale") : -1;
+	spresent = profsection(prof, "present");
+	supload = profsection(prof, c->gpu || c->dump ? "step" : "upload");
+	swait = profsection(prof, "wait");
+	smove = c->gpu || c->dump ? -1 : profsection(prof, "move");
+	start = nextstep = monotime();
+	mkpace(&pace, 1.0 / c->fps, 0);
+	signal(SIGTERM, term);
+	if (prof)
+		signal(SIGUSR1, profsig);
+	while (!sigclose && (!c->frames || frame < c->frames)) {
+		++frame;
+		if (out->visible && !out->visible(out, 0)) {
+			fputs("Root window hidden, pausing.\n", stderr);
+			if (!c->gpu)
+				simpause(&web->sim, 1);
+			while (!sigclose && !out->visible(out, 1))
+				;
+			if (!c->gpu)
+				simpause(&web->sim, 0);
+			fputs("Root window visible, resuming.\n", stderr);
+			/* start over from now rather than skip ahead */
+			mkpace(&pace, 1.0 / (c->fps * levels[level].fps), 0);
+			nextstep = monotime();
+			govreset(g);
+		}
+		stale = layout != out->layout;
+		if (stale) {
+			fprintf(stderr, "Drawing on %d monitor%s.\n",
+			        out->nmonitors, out->nmonitors > 1 ? "s" : "");
+			layout = out->layout;
+		}
 		/* draw web */
 		const time_t tempt = time(NULL);
 		localt = localtime(&tempt);
-		const GLfloat lrot = TWO_PI * (localt->tm_hour + (localt->tm_min + localt->tm_sec / 60.0f) / 60.0f) / 24.0f - M_PI_2;
-		GLfloat time = (GLfloat) clock() / CLOCKS_PER_SEC;
+		/* a loop's camera goes by frames, to come round on time */
+		GLfloat time = c->loop > 0.0 || c->dump ? (frame - 1) / c->fps : monotime() - start;
+		/*
+		 * a loop's light stays put, and a dump's day starts at midnight, to
+		 * come out alike every run
+		 */
+		const GLfloat day = c->loop > 0.0 ? LOOP_DAY : c->dump ? time / 86400.0f : (localt->tm_hour + (localt->tm_min + localt->tm_sec / 60.0f) / 60.0f) / 24.0f;
+		const GLfloat lrot = TWO_PI * day - M_PI_2;
 		const GLfloat langle = 0.5;
-		matcam(view, 0.5f, 0.05f, time / 2.0f);
-		GLuint viewloc = glGetUniformLocation(sp, "view");
-		GLuint projloc = glGetUniformLocation(sp, "projection");
-		GLint llocation = glGetUniformLocation(sp, "light");
-		glUniformMatrix4fv(viewloc, 1, GL_FALSE, view);
-		glUniformMatrix4fv(projloc, 1, GL_FALSE, projection);
-		glUniform3f(llocation, sin(langle) * cos(lrot), sin(langle) * sin(lrot), cos(langle));
-		glUseProgram(sp);
+		fr.light[0] = sin(langle) * cos(lrot);
+		fr.light[1] = sin(langle) * sin(lrot);
+		fr.light[2] = cos(langle);
+		matcam(fr.view, 0.5f, 0.05f, time / 2.0f);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, offsetof(struct frame, view),
+		                sizeof(fr) - offsetof(struct frame, view), fr.view);
+		if (c->gpu)
+			glBindTexture(GL_TEXTURE_2D, gpusimtex(&web->gsim));
+		govbegin(g);
+		if (c->check) {
+			/* same frame through the geometry shader first */
+			view = scalebegin(sc, out);
+			clearmonitors(view);
+			drawmonitors(view, refsp, web->vao, web->numi, web->itype,
+			             ubo, stale);
+			scaleend(sc, out);
+			out->present(out);
+			readout(out, refpx);
+		}
+		profbegin(prof, sclear);
+		view = scalebegin(sc, out);
+		clearmonitors(view);
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, numi, GL_UNSIGNED_INT, 0);
+		profbegin(prof, sdraw);
+		drawmonitors(view, sp, web->vao, web->numi, web->itype, ubo, stale);
+		profbegin(prof, sscale);
+		scaleend(sc, out);
+		if (!c->upsample)
+			ringfence(&web->ring);
+		profbegin(prof, spresent);
+		out->present(out);
+		govend(g);
+		profend(prof);
+		if (c->check) {
+			readout(out, px);
+			ndiff += pixdiff(refpx, px, npx, &maxdiff);
+			nchecked += npx;
+		}
 
-		glBindVertexArray(0);
-		glXSwapBuffers(disp, root);
+		/*
+		 * movements, stepped as often as the simulation thread would, and
+		 * for a dump by frames: as many as are due by the end of this one,
+		 * counted in integers so that every run rounds alike
+		 */
+		profbegin(prof, supload);
+		now = monotime();
+		if (c->dump)
+			due = (unsigned long long) frame * STEP_RATE * 1000 / mfps;
+		for (n = 0; c->dump ? nsteps < due : c->gpu && n < GPU_MAX_LAG
+		                                     && nextstep <= now; ++n) {
+			if (c->check || !c->gpu)
+				poolmove(&web->pool);
+			if (c->gpu)
+				gpustep(&web->gsim);
+			if (c->check) {
+				gpuread(&web->gsim, web->zstage);
+				maxerr = fmax(maxerr, maxdist(web->w.cur, web->zstage,
+				                              web->numv));
+			}
+			nextstep += 1.0 / STEP_RATE;
+			++nsteps;
+		}
+		if (c->gpu && !c->dump && nextstep <= now)
+			nextstep = now;
 
-		/* transfer to root */
-		//char buffer[4 * scr->width * scr->height];
-		//glReadPixels(0, 0, scr->width, scr->height, GL_BGRA, GL_UNSIGNED_BYTE, buffer);
-		//setbkg(disp, scr, buffer);
+		/* movements, stepped by the simulation thread */
+		snap = c->dump ? web->w.cur : c->gpu ? web->last : weblatest(web);
+		/* stepping here cycles through the same buffers, so count steps */
+		fresh = c->gpu ? 0 : c->dump ? n > 0 : snap != web->last;
+		if (fresh && c->upsample) {
+			/* one transfer, the driver pipelines it behind the draw */
+			glBindTexture(GL_TEXTURE_2D, web->hmap);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, web->wwidth,
+			                web->wheight, GL_RED, GL_FLOAT, snap);
+			web->last = snap;
+		} else if (fresh) {
+			/* the simulation thread wrote into the ring already */
+			if (c->dump)
+				snap = memcpy(ringbegin(&web->ring), snap, web->zsize);
+			zpointer(web, ringuse(&web->ring, snap));
+			web->last = snap;
+		}
 
+		/* the simulation thread times itself, average its new steps */
+		dmoves = c->gpu || c->dump ? 0 : __atomic_load_n(&web->sim.moves, __ATOMIC_ACQUIRE) - web->moves;
+		if (prof && dmoves) {
+			web->moves += dmoves;
+			dmovens = __atomic_load_n(&web->sim.movens, __ATOMIC_RELAXED) - web->movens;
+			web->movens += dmovens;
+			profadd(prof, smove, dmovens / 1e6 / dmoves);
+		}
+		profbegin(prof, swait);
+		if (!c->dump)
+			pacewait(&pace);
+		profframe(prof);
+		scaleframe(sc);
+		if (sigprof) {
+			sigprof = 0;
+			dumpprof(prof, c->prof);
+		}
 
-		/* movements */
-		move(wwidth, wheight, vcur, vprev);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, 3 * numv * sizeof(GLfloat), vcur, GL_STREAM_DRAW);
-		sleep(t);
+		/* a new level takes effect between frames, the wave carries over */
+		if ((lv = govframe(g)) == level)
+			continue;
+		level = lv;
+		l = &levels[level];
+		mkpace(&pace, 1.0 / (c->fps * l->fps), 0);
+		if (!scalelimit(sc, c->scale * l->scale, l->samples))
+			fputs("Warning: failed to change the render scale.\n", stderr);
+		gw = shrink(c->gwidth, l->shift);
+		gh = shrink(c->gheight, l->shift);
+		if (gw == web->wwidth && gh == web->wheight)
+			continue;
+		next = web == webs ? webs + 1 : webs;
+		webstop(web, c);
+		if (mkweb(next, gw, gh, c, sp, refsp, simsp, &web->w)) {
+			freeweb(web, c);
+			web = next;
+		} else {
+			fputs("Warning: keeping the current grid.\n", stderr);
+			if (!c->gpu && !c->dump)
+				webstart(web);
+		}
+		nextstep = monotime();
 	}
+	if (prof)
+		signal(SIGUSR1, SIG_DFL);
 	signal(SIGTERM, SIG_DFL);
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &vbo);
-	glXMakeCurrent(disp, None, NULL);
-	glXDestroyContext(disp, context);
-	puts("Success!");
-	return EXIT_SUCCESS;
+	freeweb(web, c);
+	if (c->check && c->gpu) {
+		fprintf(stderr, "Check: GPU heights at most %g from the CPU's "
+		        "over %lu steps.\n", maxerr, nsteps);
+		if (!(maxerr <= CHECK_SIM)) {
+			fputs("Error: GPU simulation drifted from the CPU's.\n",
+			      stderr);
+			r = EXIT_FAILURE;
+		}
+	}
+	if (prof) {
+		dumpprof(prof, c->prof);
+		freeprof(prof);
+		free(prof);
+	}
+	if (g)
+		freegov(g);
+	if (sc)
+		freescale(sc);
+	if (c->check) {
+		fprintf(stderr, "Check: %zu of %zu pixels differ by more than "
+		        "%d, at most by %d.\n", ndiff, nchecked,
+		        CHECK_TOLERANCE, maxdiff);
+		if (ndiff * 1000000 > nchecked * CHECK_PPM) {
+			fputs("Error: output differs from the geometry shader's.\n",
+			      stderr);
+			r = EXIT_FAILURE;
+		}
+	}
+	glDeleteBuffers(1, &ubo);
+	glDeleteProgram(simsp);
+	glDeleteProgram(refsp);
+	glDeleteProgram(sp);
+	free(refpx);
+	if (r == EXIT_SUCCESS)
+		fputs("Success!\n", stderr);
+	return r;
 
-	errcontext:
-	glXMakeCurrent(disp, None, NULL);
-	glXDestroyContext(disp, context);
+	errweb:
+	glDeleteBuffers(1, &ubo);
+	freeweb(web, c);
+	errsp:
+	glDeleteProgram(simsp);
+	glDeleteProgram(refsp);
+	glDeleteProgram(sp);
+	free(refpx);
 	return EXIT_FAILURE;
 }
 
+/*
+ * Shows a baked loop on the background pixmap, with neither OpenGL nor the
+ * simulation running. Runs until SIGTERM, or for c->frames frames if not 0.
+ */
 int
-main(void)
+replay(Display *const disp, const struct loop *const l,
+       const struct conf *const c)
 {
-	Display *const disp = XOpenDisplay(NULL);
-	if (disp) {
-		Screen *const scr = ScreenOfDisplay(disp, DefaultScreen(disp));
-		const int r = graphics(16, 9, disp, scr, 1.0f / 15);
-		XCloseDisplay(disp);
-		return r;
-	} else {
+	const double period = 1.0 / l->head->fps;
+	unsigned long frame = 0;
+	struct pace pace;
+	struct xbkg b;
+	uint32_t i = 0;
+	int r = EXIT_SUCCESS;
+	memset(&b, 0, sizeof(b));
+	if (!mkxbkg(&b, disp))
+		return EXIT_FAILURE;
+	if (b.img->width != (int) l->head->width
+	    || b.img->height != (int) l->head->height) {
+		fputs("Error: the loop is not the size of the screen.\n", stderr);
+		freexbkg(&b);
+		return EXIT_FAILURE;
+	}
+	mkpace(&pace, period, 0);
+	signal(SIGTERM, term);
+	while (!sigclose && (!c->frames || frame++ < c->frames)) {
+		bkgevents(&b);
+		if (!rootshows(&b.x, 0)) {
+			fputs("Root window hidden, pausing.\n", stderr);
+			while (!sigclose && !rootshows(&b.x, 1))
+				bkgevents(&b);
+			fputs("Root window visible, resuming.\n", stderr);
+			mkpace(&pace, period, 0);
+		}
+		shmwait(&b);
+		if (!loopframe(l, i, b.img->data, b.img->bytes_per_line)) {
+			fputs("Error: the loop file is damaged.\n", stderr);
+			r = EXIT_FAILURE;
+			break;
+		}
+		bkgput(&b);
+		i = (i + 1) % l->head->nframes;
+		pacewait(&pace);
+	}
+	signal(SIGTERM, SIG_DFL);
+	freexbkg(&b);
+	return r;
+}
+
+/*
+ * Where the loop for key goes: under $XDG_CACHE_HOME, or ~/.cache, in a
+ * directory of its own, made if missing, and named after the key's hash.
+ */
+int
+looppath(char path[LOOP_MAX_PATH], const char *const key)
+{
+	const char *const cache = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	size_t n;
+	if (cache && *cache)
+		n = snprintf(path, LOOP_MAX_PATH, "%s", cache);
+	else if (home && *home)
+		n = snprintf(path, LOOP_MAX_PATH, "%s/.cache", home);
+	else
+		return 0;
+	if (n >= LOOP_MAX_PATH - 64)
+		return 0;
+	mkdir(path, 0700);
+	n += sprintf(path + n, "/gl-background");
+	mkdir(path, 0700);
+	sprintf(path + n, "/%016llx.loop", (unsigned long long) loophash(key));
+	return 1;
+}
+
+/*
+ * -l: replays the loop baked for these settings, baking it first if there is
+ * none yet. The key holds everything that changes the frames, so a loop for
+ * other settings is never mistaken for this one, and LOOP_VERSION covers
+ * changes to the drawing itself. Baking rounds the loop to whole turns of
+ * the camera and draws it in real time on the background, as -P would, but
+ * lit as at LOOP_DAY rather than by the clock, which the key cannot hold.
+ */
+int
+playloop(struct conf *const c, const int msaa)
+{
+	const double turns = fmax(1.0, floor(c->loop / CAMERA_PERIOD + 0.5));
+	const uint32_t nframes = turns * CAMERA_PERIOD * c->fps + 0.5;
+	const unsigned long frames = c->frames;
+	uint32_t nblend = LOOP_BLEND * c->fps + 0.5;
+	char key[LOOP_MAX_KEY], path[LOOP_MAX_PATH];
+	struct output out;
+	struct loopw lw;
+	struct loop l;
+	Display *disp;
+	int r;
+	if (nblend < 1)
+		nblend = 1;
+	if (nblend > nframes)
+		nblend = nframes;
+	if (!(disp = XOpenDisplay(NULL))) {
 		fputs("Error: failed to open X display.\n", stderr);
 		return EXIT_FAILURE;
 	}
+	snprintf(key, sizeof(key), "%dx%d grid %zux%zu upsample %zu scale %g "
+	         "budget %g seed %llu sim %s fps %g frames %lu blend %lu",
+	         DisplayWidth(disp, DefaultScreen(disp)),
+	         DisplayHeight(disp, DefaultScreen(disp)), c->gwidth, c->gheight,
+	         c->upsample, c->scale, c->budget, (unsigned long long) c->seed,
+	         c->gpu ? "gpu" : "cpu", c->fps, (unsigned long) nframes,
+	         (unsigned long) nblend);
+	if (!looppath(path, key)) {
+		fputs("Error: no cache directory for the loop.\n", stderr);
+		goto errdisp;
+	}
+	if (!mkloop(&l, path, key)) {
+		fprintf(stderr, "Baking %lu frames, %g s, into %s.\n",
+		        (unsigned long) nframes, nframes / c->fps, path);
+		if (!mkloopw(&lw, path, key, DisplayWidth(disp, DefaultScreen(disp)),
+		             DisplayHeight(disp, DefaultScreen(disp)), nframes,
+		             nblend, c->fps))
+			goto errdisp;
+		if (!mkbkgout(&out, disp, msaa, &lw)) {
+			freeloopw(&lw);
+			goto errdisp;
+		}
+		c->frames = nframes + nblend;
+		r = graphics(c->gwidth, c->gheight, &out, c);
+		out.close(&out);
+		if (lw.failed)
+			r = EXIT_FAILURE;
+		else if (r == EXIT_SUCCESS && !sigclose && !loopdone(&lw))
+			r = EXIT_FAILURE;
+		freeloopw(&lw);
+		if (r != EXIT_SUCCESS || sigclose)
+			goto end;
+		if (!mkloop(&l, path, key)) {
+			fprintf(stderr, "Error: cannot read %s back.\n", path);
+			goto errdisp;
+		}
+		c->frames = frames;
+	}
+	fprintf(stderr, "Replaying %s.\n", path);
+	r = replay(disp, &l, c);
+	freeloop(&l);
+	end:
+	XCloseDisplay(disp);
+	return r;
+
+	errdisp:
+	XCloseDisplay(disp);
+	return EXIT_FAILURE;
+}
+
+void
+usage(void)
+{
+	fputs("usage: glx [-g widthxheight] [-t threads] [-f fps] [-v] [-H] [-P] "
+	      "[-s widthxheight] [-n frames] [-u factor] [-G] [-c] [-p file] "
+	      "[-S seed] [-r scale] [-b ms] [-q cpu%,gpu%] [-l seconds] "
+	      "[-D [y4m:|bgra:]file]\n", stderr);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct conf c;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	struct output out;
+	Display *disp = NULL;
+	struct dump dump;
+	double start = 0.0;
+	char *end, comma;
+	int i, r, msaa;
+	memset(&c, 0, sizeof(c));
+	c.threads = ncpu > 1 ? ncpu : 1;
+	c.fps = STEP_RATE;
+	c.width = 1920;
+	c.height = 1080;
+	c.gwidth = 16;
+	c.gheight = 9;
+	c.seed = 1;
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			c.threads = strtoul(argv[++i], &end, 10);
+			if (*end || !c.threads)
+				goto errusage;
+		} else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+			c.fps = strtod(argv[++i], &end);
+			if (*end || !(c.fps > 0.0))
+				goto errusage;
+		} else if (!strcmp(argv[i], "-v")) {
+			c.vsync = 1;
+		} else if (!strcmp(argv[i], "-H")) {
+			c.headless = 1;
+		} else if (!strcmp(argv[i], "-P")) {
+			c.bkg = 1;
+		} else if (!strcmp(argv[i], "-c")) {
+			c.check = 1;
+		} else if (!strcmp(argv[i], "-G")) {
+			c.gpu = 1;
+		} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			c.scale = strtof(argv[++i], &end);
+			if (*end || !(c.scale > 0.0f && c.scale <= 1.0f))
+				goto errusage;
+		} else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			c.budget = strtod(argv[++i], &end);
+			if (*end || !(c.budget > 0.0))
+				goto errusage;
+		} else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+			if (sscanf(argv[++i], "%lf,%lf%c", &c.cpushare, &c.gpushare, &comma) != 2
+			    || c.cpushare < 0.0 || c.gpushare < 0.0
+			    || !(c.cpushare > 0.0 || c.gpushare > 0.0))
+				goto errusage;
+			c.cpushare /= 100.0;
+			c.gpushare /= 100.0;
+		} else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+			c.loop = strtod(argv[++i], &end);
+			if (*end || !(c.loop > 0.0))
+				goto errusage;
+		} else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+			c.dump = argv[++i];
+		} else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+			c.prof = argv[++i];
+		} else if (!strcmp(argv[i], "-S") && i + 1 < argc) {
+			c.seed = strtoull(argv[++i], &end, 0);
+			if (*end)
+				goto errusage;
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &c.width, &c.height) != 2
+			    || c.width < 1 || c.height < 1)
+				goto errusage;
+		} else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+			if (sscanf(argv[++i], "%zux%zu", &c.gwidth, &c.gheight) != 2
+			    || c.gwidth < 2 || c.gheight < 2)
+				goto errusage;
+		} else if (!strcmp(argv[i], "-u") && i + 1 < argc) {
+			c.upsample = strtoul(argv[++i], &end, 10);
+			if (*end || !c.upsample)
+				goto errusage;
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			c.frames = strtoul(argv[++i], &end, 10);
+			if (*end)
+				goto errusage;
+		} else {
+			goto errusage;
+		}
+	}
+	/* comparing presents every frame twice, keep that off screen */
+	if (c.check && !c.headless)
+		goto errusage;
+	/* the background pixmap belongs to an X server */
+	if (c.bkg && c.headless)
+		goto errusage;
+	/* a loop plays on the background, and the governor would change it */
+	if (c.loop > 0.0 && (c.headless || c.cpushare > 0.0 || c.gpushare > 0.0))
+		goto errusage;
+	/* a dump is headless, and every frame it draws goes out */
+	if (c.dump && (c.bkg || c.check || c.loop > 0.0 || c.cpushare > 0.0
+	               || c.gpushare > 0.0))
+		goto errusage;
+	/* the GPU's heights can only be drawn from a heightmap */
+	if (c.gpu && !c.upsample)
+		c.upsample = 1;
+	/* a budget scales down from native size unless told otherwise */
+	if ((c.budget > 0.0 || c.cpushare > 0.0 || c.gpushare > 0.0) && !c.scale)
+		c.scale = 1.0f;
+	/* rendering scaled, the samples belong to the scaled framebuffer */
+	msaa = c.scale ? 0 : MSAA;
+	if (c.loop > 0.0) {
+		return playloop(&c, msaa);
+	} else if (c.dump) {
+		/* a reader gone away shows as a failed write */
+		signal(SIGPIPE, SIG_IGN);
+		if (!mkdump(&dump, c.dump, c.width, c.height, c.fps))
+			return EXIT_FAILURE;
+		if (!mkdumpout(&out, c.width, c.height, msaa, &dump)) {
+			freedump(&dump);
+			return EXIT_FAILURE;
+		}
+		start = monotime();
+	} else if (c.headless) {
+		if (!mkeglout(&out, c.width, c.height, msaa))
+			return EXIT_FAILURE;
+	} else {
+		if (!(disp = XOpenDisplay(NULL))) {
+			fputs("Error: failed to open X display.\n", stderr);
+			return EXIT_FAILURE;
+		}
+		r = c.bkg ? mkbkgout(&out, disp, msaa, NULL) : mkglxout(&out, disp, msaa, c.vsync);
+		if (!r) {
+			XCloseDisplay(disp);
+			return EXIT_FAILURE;
+		}
+	}
+	r = graphics(c.gwidth, c.gheight, &out, &c);
+	out.close(&out);
+	if (c.dump) {
+		start = monotime() - start;
+		freedump(&dump);
+		fprintf(stderr, "Dumped %lu frames in %.3f s, %.1f frames per "
+		        "second.\n", dump.frames, start, dump.frames / start);
+		if (dump.failed)
+			r = EXIT_FAILURE;
+	}
+	if (disp)
+		XCloseDisplay(disp);
+	return r;
+
+	errusage:
+	usage();
+	return EXIT_FAILURE;
 }
@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+
+#include "gov.h"
+#include "pace.h"
+
+/* shares are of one core and of the GPU, 0 for no limit */
+void
+mkgov(struct gov *const g, const double cpu, const double gpu,
+      const int nlevels)
+{
+	g->cpu = cpu;
+	g->gpu = gpu;
+	g->level = 0;
+	g->nlevels = nlevels;
+	g->timer = gpu > 0.0 && mkgputimer(&g->gputime);
+	if (gpu > 0.0 && !g->timer)
+		fputs("Warning: no timer queries, the GPU share is not governed.\n", stderr);
+	govreset(g);
+}
+
+/* starts a new window from scratch, say after a pause */
+void
+govreset(struct gov *const g)
+{
+	if (!g)
+		return;
+	g->start = monotime();
+	g->cpustart = proctime();
+	g->gpums = 0.0;
+	g->calm = 0;
+	g->settle = 0;
+}
+
+void
+govbegin(struct gov *const g)
+{
+	if (g && g->timer)
+		gputimerbegin(&g->gputime);
+}
+
+void
+govend(struct gov *const g)
+{
+	if (g && g->timer)
+		gputimerend(&g->gputime);
+}
+
+static void
+decide(struct gov *const g, const double cpu, const double gpu)
+{
+	const int over = (g->cpu > 0.0 && cpu > g->cpu)
+	                 || (g->gpu > 0.0 && gpu > g->gpu);
+	const int under = (g->cpu <= 0.0 || cpu < GOV_LOW * g->cpu)
+	                  && (g->gpu <= 0.0 || gpu < GOV_LOW * g->gpu);
+	const int old = g->level;
+	if (g->settle) {
+		g->settle = 0;
+		return;
+	}
+	if (over) {
+		g->calm = 0;
+		if (g->level < g->nlevels - 1)
+			++g->level;
+	} else if (under && ++g->calm >= GOV_CALM) {
+		g->calm = 0;
+		if (g->level > 0)
+			--g->level;
+	} else if (!under) {
+		g->calm = 0;
+	}
+	if (g->level != old) {
+		fprintf(stderr, "Quality level %d, %.0f%% of a core and %.0f%% "
+		        "of the GPU.\n", g->level, 100.0 * cpu, 100.0 * gpu);
+		g->settle = 1;
+	}
+}
+
+/*
+ * Collects the GPU time from GPUTIMER_LAG frames ago if it is there, and returns
+ * the level to draw the next frames at, which only changes as a window ends.
+ * Without a governor, that is always 0.
+ */
+int
+govframe(struct gov *const g)
+{
+	const double now = monotime();
+	double cpu, ms;
+	if (!g)
+		return 0;
+	if (g->timer && gputimerframe(&g->gputime, &ms))
+		g->gpums += ms;
+	if (now - g->start < GOV_WINDOW)
+		return g->level;
+	cpu = proctime() - g->cpustart;
+	decide(g, cpu / (now - g->start), g->gpums / 1e3 / (now - g->start));
+	g->start = now;
+	g->cpustart = proctime();
+	g->gpums = 0.0;
+	return g->level;
+}
+
+void
+freegov(struct gov *const g)
+{
+	if (g->timer)
+		freegputimer(&g->gputime);
+}
@@ -0,0 +1,40 @@
+#ifndef GOV_H
+#define GOV_H
+
+#include "gputimer.h"
+
+/* seconds of measurements behind every decision */
+#define GOV_WINDOW 1.0
+/* quality only goes back up below that much of the shares */
+#define GOV_LOW 0.5
+/* for that many windows in a row */
+#define GOV_CALM 4
+
+/*
+ * Quality governor. Over windows of GOV_WINDOW seconds, it measures the share
+ * of a core the process uses (every thread, so the simulation too) and the
+ * share of the GPU's time spent between govbegin() and govend(). One window
+ * over either share goes a level down; GOV_CALM windows in a row under
+ * GOV_LOW of both go a level up. The window right after a change is not
+ * counted, as it pays for the change itself. Level 0 is the best quality.
+ * govreset(), govbegin(), govend() and govframe() accept a NULL governor,
+ * which does nothing and stays at level 0.
+ */
+struct gov {
+	double cpu, gpu;
+	int level, nlevels;
+	double start, cpustart, gpums;
+	int calm, settle;
+	struct gputimer gputime;
+	int timer;
+};
+
+void mkgov(struct gov *const g, const double cpu, const double gpu,
+           const int nlevels);
+void govreset(struct gov *const g);
+void govbegin(struct gov *const g);
+void govend(struct gov *const g);
+int govframe(struct gov *const g);
+void freegov(struct gov *const g);
+
+#endif
@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+
+#include "gpusim.h"
+
+/*
+ * prog reads cur, prev and kick from texture units 0, 1 and 2. kicks holds
+ * one byte per row and must stay valid. filter only matters to whoever
+ * samples the heights afterwards, the steps themselves use texelFetch().
+ * Leaves texture unit 0 active, and nothing to free when it fails.
+ */
+int
+mkgpusim(struct gpusim *const g, const struct wave *const w,
+         const GLuint prog, unsigned char *const kicks, const GLint filter)
+{
+	const float *const init[3] = { w->prev, w->cur, NULL };
+	GLint fbo;
+	int i;
+	g->width = w->width;
+	g->height = w->height;
+	g->prog = prog;
+	g->kicks = kicks;
+	g->cur = 1;
+	g->seed = w->seed;
+	g->step = w->step;
+	g->kick = g->vao = 0;
+	/* an error left over from before is not ours */
+	while (glGetError() != GL_NO_ERROR)
+		;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+	glGenTextures(3, g->tex);
+	glGenFramebuffers(3, g->fbo);
+	for (i = 0; i < 3; ++i) {
+		glBindTexture(GL_TEXTURE_2D, g->tex[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, g->width, g->height, 0,
+		             GL_RED, GL_FLOAT, init[i]);
+		if (glGetError() != GL_NO_ERROR)
+			goto err;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g->fbo[i]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		                       GL_TEXTURE_2D, g->tex[i], 0);
+		if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fputs("Error: cannot render into float textures.\n", stderr);
+			goto err;
+		}
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+
+	/* one texel per row, so no row alignment to worry about */
+	glGenTextures(1, &g->kick);
+	glBindTexture(GL_TEXTURE_2D, g->kick);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, g->height, 1, 0, GL_RED,
+	             GL_UNSIGNED_BYTE, NULL);
+	if (glGetError() != GL_NO_ERROR)
+		goto err;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	/* the pass is a single triangle covering the grid, made up from IDs */
+	glGenVertexArrays(1, &g->vao);
+	glUseProgram(prog);
+	glUniform1i(glGetUniformLocation(prog, "cur"), 0);
+	glUniform1i(glGetUniformLocation(prog, "prev"), 1);
+	glUniform1i(glGetUniformLocation(prog, "kick"), 2);
+	glUniform4f(glGetUniformLocation(prog, "kpfh"), WAVE_K, WAVE_P, WAVE_F, WAVE_H);
+	if (glGetError() == GL_NO_ERROR)
+		return 1;
+
+	err:
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	freegpusim(g);
+	return 0;
+}
+
+/*
+ * The kicks are the ones move() would give, so a CPU and a GPU wave that
+ * start out alike keep stepping alike. The bound framebuffer, viewport and
+ * unit 0 texture are left as they were.
+ */
+void
+gpustep(struct gpusim *const g)
+{
+	const int next = (g->cur + 1) % 3, prev = (g->cur + 2) % 3;
+	GLint fbo, tex, view[4];
+	size_t r;
+	for (r = 0; r < g->height; ++r)
+		g->kicks[r] = kick(g->seed, g->step, g->height, r) ? 255 : 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &tex);
+	glGetIntegerv(GL_VIEWPORT, view);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, g->kick);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g->height, 1, GL_RED,
+	                GL_UNSIGNED_BYTE, g->kicks);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, g->tex[prev]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, g->tex[g->cur]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g->fbo[next]);
+	glViewport(0, 0, g->width, g->height);
+	glUseProgram(g->prog);
+	glBindVertexArray(g->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glViewport(view[0], view[1], view[2], view[3]);
+	g->cur = next;
+	++g->step;
+}
+
+/* texture holding the latest heights */
+GLuint
+gpusimtex(const struct gpusim *const g)
+{
+	return g->tex[g->cur];
+}
+
+static void
+readtex(const struct gpusim *const g, const int i, float z[])
+{
+	GLint fbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, g->fbo[i]);
+	glReadPixels(0, 0, g->width, g->height, GL_RED, GL_FLOAT, z);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+}
+
+/* copies the latest heights back, which stalls: for checking only */
+void
+gpuread(const struct gpusim *const g, float z[])
+{
+	readtex(g, g->cur, z);
+}
+
+/* the whole wave back into w, to go on with elsewhere; stalls too */
+void
+gpusave(const struct gpusim *const g, struct wave *const w)
+{
+	readtex(g, g->cur, w->cur);
+	readtex(g, (g->cur + 2) % 3, w->prev);
+	w->step = g->step;
+}
+
+void
+freegpusim(struct gpusim *const g)
+{
+	glDeleteVertexArrays(1, &g->vao);
+	glDeleteTextures(1, &g->kick);
+	glDeleteFramebuffers(3, g->fbo);
+	glDeleteTextures(3, g->tex);
+}
@@ -0,0 +1,35 @@
+#ifndef GPUSIM_H
+#define GPUSIM_H
+
+#include <stddef.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "sim.h"
+
+/*
+ * The wave stepped on the GPU. Three R32F textures take turns as prev, cur
+ * and next, and a step is one pass of the program given to mkgpusim() into
+ * next. Heights stay in video memory; only the kicks of the first column,
+ * drawn from the same stream as the CPU's, go up every step.
+ */
+struct gpusim {
+	size_t width, height;
+	GLuint prog, vao, kick;
+	GLuint tex[3], fbo[3];
+	int cur;
+	uint64_t seed, step;
+	unsigned char *kicks;
+};
+
+int mkgpusim(struct gpusim *const g, const struct wave *const w,
+             const GLuint prog, unsigned char *const kicks,
+             const GLint filter);
+void gpustep(struct gpusim *const g);
+GLuint gpusimtex(const struct gpusim *const g);
+void gpuread(const struct gpusim *const g, float z[]);
+void gpusave(const struct gpusim *const g, struct wave *const w);
+void freegpusim(struct gpusim *const g);
+
+#endif
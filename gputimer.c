@@ -0,0 +1,65 @@
+#include "gputimer.h"
+
+/* 0 without timer queries, then there is nothing to free */
+int
+mkgputimer(struct gputimer *const t)
+{
+	int i;
+	if (!GLEW_ARB_timer_query && !GLEW_VERSION_3_3)
+		return 0;
+	t->slot = t->open = 0;
+	for (i = 0; i < GPUTIMER_LAG; ++i)
+		t->pending[i] = 0;
+	glGenQueries(2 * GPUTIMER_LAG, t->queries[0]);
+	return 1;
+}
+
+void
+gputimerbegin(struct gputimer *const t)
+{
+	if (t->open || t->pending[t->slot])
+		return;
+	glQueryCounter(t->queries[t->slot][0], GL_TIMESTAMP);
+	t->open = 1;
+}
+
+void
+gputimerend(struct gputimer *const t)
+{
+	if (!t->open)
+		return;
+	glQueryCounter(t->queries[t->slot][1], GL_TIMESTAMP);
+	t->pending[t->slot] = 1;
+	t->open = 0;
+}
+
+/*
+ * Moves on to the pair from GPUTIMER_LAG frames ago, and returns whether it
+ * held a time, in ms.
+ */
+int
+gputimerframe(struct gputimer *const t, double *const ms)
+{
+	GLuint64 ns[2];
+	GLint done;
+	gputimerend(t);
+	t->slot = (t->slot + 1) % GPUTIMER_LAG;
+	if (!t->pending[t->slot])
+		return 0;
+	glGetQueryObjectiv(t->queries[t->slot][1], GL_QUERY_RESULT_AVAILABLE, &done);
+	if (!done)
+		return 0;
+	glGetQueryObjectui64v(t->queries[t->slot][0], GL_QUERY_RESULT, &ns[0]);
+	glGetQueryObjectui64v(t->queries[t->slot][1], GL_QUERY_RESULT, &ns[1]);
+	t->pending[t->slot] = 0;
+	if (ns[1] <= ns[0])
+		return 0;
+	*ms = (ns[1] - ns[0]) / 1e6;
+	return 1;
+}
+
+void
+freegputimer(struct gputimer *const t)
+{
+	glDeleteQueries(2 * GPUTIMER_LAG, t->queries[0]);
+}
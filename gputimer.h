@@ -0,0 +1,30 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+/* frames of timestamp queries in flight before one is read back */
+#define GPUTIMER_LAG 4
+
+/*
+ * GPU time spent between gputimerbegin() and gputimerend(), once a frame.
+ * Each frame takes the next of a ring of GPUTIMER_LAG pairs of timestamp
+ * queries, and a pair is only read back once the GPU is through with it,
+ * GPUTIMER_LAG frames later; a frame whose pair is still pending goes
+ * untimed rather than stall. Timestamps rather than elapsed time, so that
+ * timers can overlap. A begin while the timer runs does nothing, and so
+ * does an end while it does not.
+ */
+struct gputimer {
+	GLuint queries[GPUTIMER_LAG][2];
+	int pending[GPUTIMER_LAG], slot, open;
+};
+
+int mkgputimer(struct gputimer *const t);
+void gputimerbegin(struct gputimer *const t);
+void gputimerend(struct gputimer *const t);
+int gputimerframe(struct gputimer *const t, double *const ms);
+void freegputimer(struct gputimer *const t);
+
+#endif
@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loop.h"
+
+#define LOOP_MAGIC "glbgloop"
+#define RUN 0x80000000u
+/* shorter repeats take less room as they are */
+#define MIN_RUN 3
+
+/* FNV-1a, to name a file after its key */
+uint64_t
+loophash(const char *const key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const char *c;
+	for (c = key; *c; ++c)
+		h = (h ^ (unsigned char) *c) * 0x100000001b3ULL;
+	return h;
+}
+
+/* one frame, or 0 if it runs past end or past its rows */
+static int
+decode(const uint32_t *p, const uint32_t *const end, const uint32_t width,
+       const uint32_t height, void *const dst, const size_t stride)
+{
+	uint32_t *row, x, y, n, k;
+	for (y = 0; y < height; ++y) {
+		row = (uint32_t *) ((unsigned char *) dst + y * stride);
+		for (x = 0; x < width; x += n) {
+			if (p == end)
+				return 0;
+			n = *p & ~RUN;
+			if (!n || n > width - x)
+				return 0;
+			if (*p++ & RUN) {
+				if (p == end)
+					return 0;
+				for (k = 0; k < n; ++k)
+					row[x + k] = *p;
+				++p;
+			} else {
+				if ((size_t) (end - p) < n)
+					return 0;
+				memcpy(row + x, p, n * sizeof(*p));
+				p += n;
+			}
+		}
+	}
+	return 1;
+}
+
+/* into out, which holds at least height * (width + 1) words; returns bytes */
+static size_t
+encode(const int width, const int height, const void *const px,
+       const size_t stride, uint32_t *const out)
+{
+	const uint32_t *row;
+	uint32_t *o = out, *lit;
+	int x, y, n;
+	for (y = 0; y < height; ++y) {
+		row = (const uint32_t *) ((const unsigned char *) px + y * stride);
+		lit = NULL;
+		for (x = 0; x < width; x += n) {
+			for (n = 1; x + n < width && row[x + n] == row[x]; ++n)
+				;
+			if (n >= MIN_RUN) {
+				*o++ = RUN | n;
+				*o++ = row[x];
+				lit = NULL;
+				continue;
+			}
+			if (!lit) {
+				lit = o++;
+				*lit = 0;
+			}
+			memcpy(o, row + x, n * sizeof(*o));
+			o += n;
+			*lit += n;
+		}
+	}
+	return (o - out) * sizeof(*o);
+}
+
+/* 0 if path is missing, unreadable, stale or made with another key */
+int
+mkloop(struct loop *const l, const char *const path, const char *const key)
+{
+	const struct loophead *h;
+	struct stat st;
+	uint32_t i;
+	int fd;
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) || (size_t) st.st_size < sizeof(*h)) {
+		close(fd);
+		return 0;
+	}
+	l->size = st.st_size;
+	l->map = mmap(NULL, l->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (l->map == MAP_FAILED)
+		return 0;
+	h = l->head = l->map;
+	l->off = (const uint64_t *) (h + 1);
+	if (memcmp(h->magic, LOOP_MAGIC, sizeof(h->magic))
+	    || h->version != LOOP_VERSION
+	    || strncmp(h->key, key, LOOP_MAX_KEY) || !h->nframes
+	    || (l->size - sizeof(*h)) / sizeof(*l->off) < h->nframes)
+		goto errmap;
+	for (i = 0; i < h->nframes; ++i)
+		if (l->off[i] % sizeof(uint32_t) || l->off[i] >= l->size)
+			goto errmap;
+	return 1;
+
+	errmap:
+	munmap(l->map, l->size);
+	return 0;
+}
+
+/* frame i into dst, rows stride bytes apart; 0 if the file is damaged */
+int
+loopframe(const struct loop *const l, const uint32_t i, void *const dst,
+          const size_t stride)
+{
+	const char *const map = l->map;
+	return decode((const uint32_t *) (map + l->off[i]),
+	              (const uint32_t *) (map + l->off[i])
+	              + (l->size - l->off[i]) / sizeof(uint32_t),
+	              l->head->width, l->head->height, dst, stride);
+}
+
+void
+freeloop(struct loop *const l)
+{
+	munmap(l->map, l->size);
+}
+
+/*
+ * Bakes into a temporary file next to path, which only replaces path once
+ * loopdone() is through. Needs 1 <= nblend <= nframes and a key shorter than
+ * LOOP_MAX_KEY.
+ */
+int
+mkloopw(struct loopw *const w, const char *const path, const char *const key,
+        const int width, const int height, const uint32_t nframes,
+        const uint32_t nblend, const double fps)
+{
+	memset(w, 0, sizeof(*w));
+	memcpy(w->head.magic, LOOP_MAGIC, sizeof(w->head.magic));
+	w->head.version = LOOP_VERSION;
+	w->head.width = width;
+	w->head.height = height;
+	w->head.nframes = nframes;
+	w->head.fps = fps;
+	strncpy(w->head.key, key, LOOP_MAX_KEY - 1);
+	w->nblend = nblend;
+	w->pos = sizeof(w->head) + nframes * sizeof(*w->off);
+	w->path = malloc(strlen(path) + 1);
+	w->tmp = malloc(strlen(path) + sizeof(".tmp"));
+	w->off = calloc(nframes, sizeof(*w->off));
+	w->buf = malloc((size_t) height * (width + 1) * sizeof(*w->buf));
+	w->first = calloc(nblend, sizeof(*w->first));
+	w->firstsize = calloc(nblend, sizeof(*w->firstsize));
+	w->mix = malloc((size_t) width * height * sizeof(uint32_t));
+	if (!w->path || !w->tmp || !w->off || !w->buf || !w->first
+	    || !w->firstsize || !w->mix) {
+		fputs("Error: not enough memory to bake the loop.\n", stderr);
+		goto errw;
+	}
+	strcpy(w->path, path);
+	sprintf(w->tmp, "%s.tmp", path);
+	if (!(w->f = fopen(w->tmp, "wb"))) {
+		fprintf(stderr, "Error: cannot write %s.\n", w->tmp);
+		goto errw;
+	}
+	/* the header and offsets go in last */
+	if (fseek(w->f, w->pos, SEEK_SET)) {
+		fprintf(stderr, "Error: cannot seek in %s.\n", w->tmp);
+		goto errw;
+	}
+	return 1;
+
+	errw:
+	freeloopw(w);
+	return 0;
+}
+
+/*
+ * Takes the next frame, BGRA rows stride bytes apart. The ones past
+ * nframes fade into the first, which are only written out then.
+ */
+int
+loopadd(struct loopw *const w, const void *px, size_t stride)
+{
+	const uint32_t nframes = w->head.nframes, nblend = w->nblend;
+	const size_t rowsize = (size_t) w->head.width * sizeof(uint32_t);
+	const unsigned char *a;
+	unsigned char *m;
+	uint32_t i = w->n, y;
+	size_t x, size;
+	if (w->failed)
+		return 0;
+	if (w->n == nframes + nblend)
+		return 1;
+	if (w->n >= nframes) {
+		/* weighs from the end of the loop at first to its start at last */
+		i = w->n - nframes;
+		decode((const uint32_t *) w->first[i],
+		       (const uint32_t *) (w->first[i] + w->firstsize[i]),
+		       w->head.width, w->head.height, w->mix, rowsize);
+		free(w->first[i]);
+		w->first[i] = NULL;
+		for (y = 0; y < w->head.height; ++y) {
+			a = (const unsigned char *) px + y * stride;
+			m = w->mix + y * rowsize;
+			for (x = 0; x < rowsize; ++x)
+				m[x] = (a[x] * (nblend - i) + m[x] * i + nblend / 2) / nblend;
+		}
+		px = w->mix;
+		stride = rowsize;
+	}
+	size = encode(w->head.width, w->head.height, px, stride, w->buf);
+	++w->n;
+	if (i < nblend && w->n <= nblend) {
+		if (!(w->first[i] = malloc(size))) {
+			fputs("Error: not enough memory to bake the loop.\n", stderr);
+			w->failed = 1;
+			return 0;
+		}
+		memcpy(w->first[i], w->buf, size);
+		w->firstsize[i] = size;
+		return 1;
+	}
+	w->off[i] = w->pos;
+	if (fwrite(w->buf, 1, size, w->f) != size) {
+		fprintf(stderr, "Error: cannot write %s.\n", w->tmp);
+		w->failed = 1;
+		return 0;
+	}
+	w->pos += size;
+	return 1;
+}
+
+/* once every frame is in, puts the loop in place */
+int
+loopdone(struct loopw *const w)
+{
+	if (w->n != w->head.nframes + w->nblend) {
+		fputs("Error: the loop is missing frames.\n", stderr);
+		return 0;
+	}
+	if (fseek(w->f, 0, SEEK_SET)
+	    || fwrite(&w->head, sizeof(w->head), 1, w->f) != 1
+	    || fwrite(w->off, sizeof(*w->off), w->head.nframes, w->f) != w->head.nframes
+	    || fclose(w->f)) {
+		w->f = NULL;
+		fprintf(stderr, "Error: cannot write %s.\n", w->tmp);
+		return 0;
+	}
+	w->f = NULL;
+	if (rename(w->tmp, w->path)) {
+		fprintf(stderr, "Error: cannot rename %s.\n", w->tmp);
+		return 0;
+	}
+	return 1;
+}
+
+/* whatever loopdone() did not put in place goes */
+void
+freeloopw(struct loopw *const w)
+{
+	uint32_t i;
+	if (w->f)
+		fclose(w->f);
+	if (w->tmp)
+		remove(w->tmp);
+	for (i = 0; w->first && i < w->nblend; ++i)
+		free(w->first[i]);
+	free(w->mix);
+	free(w->firstsize);
+	free(w->first);
+	free(w->buf);
+	free(w->off);
+	free(w->tmp);
+	free(w->path);
+}
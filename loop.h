@@ -0,0 +1,70 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* bumped whenever the file layout or what gets drawn changes */
+#define LOOP_VERSION 2
+#define LOOP_MAX_KEY 256
+
+/*
+ * A baked loop of BGRA frames, made to be mapped and replayed as is. The
+ * header names the parameters the frames were drawn with as a key string,
+ * and a file whose version or key differs is stale. Each frame is a run of
+ * rows, each row a list of 32-bit words: a count n with the top bit set
+ * followed by one pixel repeated n times, or a count alone followed by n
+ * pixels as they are. Flat shading leaves long runs, and decoding is hardly
+ * more than a copy.
+ */
+struct loophead {
+	char magic[8];
+	uint32_t version;
+	uint32_t width, height, nframes;
+	double fps;
+	char key[LOOP_MAX_KEY];
+	/* then nframes offsets of uint64_t from the start of the file */
+};
+
+/* a loop mapped for replay */
+struct loop {
+	void *map;
+	size_t size;
+	const struct loophead *head;
+	const uint64_t *off;
+};
+
+/*
+ * A loop being baked from nframes + nblend frames. The last nblend fade
+ * into the first nblend, so that the end leads into the start without a
+ * jump; until they come, the first ones wait in memory, encoded. Once a
+ * frame failed to go in, failed is set and the rest are refused.
+ */
+struct loopw {
+	struct loophead head;
+	FILE *f;
+	char *path, *tmp;
+	uint32_t nblend, n;
+	int failed;
+	uint64_t pos, *off;
+	uint32_t *buf;
+	unsigned char **first;
+	size_t *firstsize;
+	unsigned char *mix;
+};
+
+uint64_t loophash(const char *const key);
+int mkloop(struct loop *const l, const char *const path,
+           const char *const key);
+int loopframe(const struct loop *const l, const uint32_t i, void *const dst,
+              const size_t stride);
+void freeloop(struct loop *const l);
+int mkloopw(struct loopw *const w, const char *const path,
+            const char *const key, const int width, const int height,
+            const uint32_t nframes, const uint32_t nblend, const double fps);
+int loopadd(struct loopw *const w, const void *px, size_t stride);
+int loopdone(struct loopw *const w);
+void freeloopw(struct loopw *const w);
+
+#endif
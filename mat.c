@@ -0,0 +1,71 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "mat.h"
+
+float
+sqr(const float x)
+{
+	return x * x;
+}
+
+void
+matproj(GLfloat mat[16], const float hfov, const float vfov,
+        const float n, const float f)
+{
+	const GLfloat d = f - n;
+	mat[0] = 1.0f / tan(hfov);
+	mat[1] = 0.0f;
+	mat[2] = 0.0f;
+	mat[3] = 0.0f;
+	mat[4] = 0.0f;
+	mat[5] = 1.0f / tan(vfov);
+	mat[6] = 0.0f;
+	mat[7] = 0.0f;
+	mat[8] = 0.0f;
+	mat[9] = 0.0f;
+	mat[10] = - (f + n) / d;
+	mat[11] = -1.0f;
+	mat[12] = 0.0f;
+	mat[13] = 0.0f;
+	mat[14] = -2 * f * n / d;
+	mat[15] = 0.0f;
+}
+
+void
+matcam(GLfloat mat[16], const float d, const float r, const float a)
+{
+	const float x = r * cosf(a);
+	const float y = r * sinf(a);
+	const float n = sqrtf(sqr(d) + sqr(r));
+	const float root = sqrtf(1.0f - sqr(y / d));
+	mat[0] = (d + sqr(y) / d) / (n * root);
+	mat[1] = 0.0f;
+	mat[2] = x / n;
+	mat[3] = 0.0f;
+	
+	mat[4] = -x * y / (n * root * d);
+	mat[5] = 1 / root;
+	mat[6] = y / n;
+	mat[7] = 0.0f;
+
+	mat[8] = -x / (n * root);
+	mat[9] = -y / (root * d);
+	mat[10] = d / n;
+	mat[11] = 0.0f;
+
+	mat[12] = -x * mat[0] - y * mat[4] - d * mat[8];
+	mat[13] = -x * mat[5] - d * mat[9];
+	mat[14] = -(sqr(r) + sqr(d)) / n;
+	mat[15] = 1.0f;
+}
+
+void
+matid(GLfloat mat[16])
+{
+	size_t i, j;
+	for (i = 0; i < 4; ++i) {
+		for (j = 0; j < 4; ++j)
+			mat[4 * i + j] = i == j;
+	}
+}
@@ -0,0 +1,13 @@
+#ifndef MAT_H
+#define MAT_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+float sqr(const float x);
+void matproj(GLfloat mat[16], const float hfov, const float vfov,
+             const float n, const float f);
+void matcam(GLfloat mat[16], const float d, const float r, const float a);
+void matid(GLfloat mat[16]);
+
+#endif
@@ -0,0 +1,269 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "mesh.h"
+#include "rng.h"
+
+#define SQRT3_2 0.8660254037844386f
+#define SQRT3 1.7320508075688772f
+
+/* quads per strip: its two rows of vertices fit a 16 entry vertex cache */
+#define STRIP_BAND 7
+#define ACMR_MAX_CACHE 64
+
+size_t
+numvert(const size_t width, const size_t height)
+{
+	return width * height;
+}
+
+size_t
+numind(const size_t width, const size_t height)
+{
+	return 6 * (width - 1) * (height - 1);
+}
+
+/* indices of initstrip(), restarts included */
+size_t
+numstrip(const size_t width, const size_t height)
+{
+	const size_t rows = height - 1;
+	const size_t bands = (width - 1 + STRIP_BAND - 1) / STRIP_BAND;
+	if (width < 2 || height < 2)
+		return 0;
+	return rows * (2 * (width - 1) + 3 * bands) + bands * (rows / 2) - 1;
+}
+
+/* the smallest index type that can still tell the restart from a vertex */
+GLenum
+indtype(const size_t width, const size_t height)
+{
+	return numvert(width, height) < 0xffff ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t
+indsize(const GLenum type)
+{
+	return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+GLuint
+restartind(const GLenum type)
+{
+	return type == GL_UNSIGNED_SHORT ? 0xffff : 0xffffffff;
+}
+
+static void
+putind(void *const ind, const size_t i, const GLuint v, const GLenum type)
+{
+	if (type == GL_UNSIGNED_SHORT)
+		((GLushort *) ind)[i] = v;
+	else
+		((GLuint *) ind)[i] = v;
+}
+
+static GLuint
+getind(const void *const ind, const size_t i, const GLenum type)
+{
+	if (type == GL_UNSIGNED_SHORT)
+		return ((const GLushort *) ind)[i];
+	return ((const GLuint *) ind)[i];
+}
+
+/* triangle side, distance between rows and how far down row 0 is */
+void
+latticedims(const size_t width, const size_t height, GLfloat *const side,
+            GLfloat *const dy, GLfloat *const offy)
+{
+	*side = fminf(2.0f / (width - 0.5f), 4.0f / (height - 1) * SQRT3);
+	*dy = *side * SQRT3_2;
+	*offy = (height - 1) * *dy / 2.0f;
+}
+
+/* hex lattice positions, stride floats apart */
+static void
+lattice(const size_t width, const size_t height, GLfloat v[],
+        const size_t stride)
+{
+	const size_t n = numvert(width, height);
+	GLfloat side, dy, offy;
+	latticedims(width, height, &side, &dy, &offy);
+	for (size_t i = 0; i < n; ++i) {
+		v[stride * i] = (i % width) * side - 1.0f;
+		if (i / width % 2)
+			v[stride * i] += side / 2.0f;
+		v[stride * i + 1] = (i / width) * dy - offy;
+	}
+}
+
+void
+initvert(const size_t width, const size_t height, GLfloat v[])
+{
+	const size_t n = numvert(width, height);
+	lattice(width, height, v, 3);
+	for (size_t i = 0; i < n; ++i)
+		v[3 * i + 2] = 0.0f; //(i == 72)? 0.5f : 0.0f; //(GLfloat) (rand() % 32 - 16) / 256 - 0.75f;
+}
+
+/* same as initvert() without z, for when z lives in a buffer of its own */
+void
+initxy(const size_t width, const size_t height, GLfloat v[])
+{
+	lattice(width, height, v, 2);
+}
+
+void
+initind(const size_t width, const size_t height, GLuint ind[])
+{
+	const size_t n = numvert(width, height);
+	size_t i = 0;
+	if (numind(width, height)) {
+		for (size_t v = 0; v < n - width; ++v) {
+			if (!((v + 1) % width))
+				continue;
+			ind[i++] = v;
+			ind[i++] = v + width;
+			if (i / width % 2) {
+				ind[i++] = v + width + 1;
+				ind[i++] = v;
+				ind[i++] = v + width + 1;
+				ind[i++] = v + 1;
+			} else {
+				ind[i++] = v + 1;
+				ind[i++] = v + 1;
+				ind[i++] = v + width;
+				ind[i++] = v + width + 1;
+			}
+		}
+	}
+}
+
+/*
+ * Same triangles as initclothtri(), as strips joined by restart indices. The
+ * grid is cut into bands of STRIP_BAND quads walked row by row, so each
+ * strip reuses the vertices the one below just transformed. Odd rows lead
+ * with a degenerate triangle to keep the winding of even rows.
+ */
+size_t
+initstrip(const size_t width, const size_t height, void *const ind,
+          const GLenum type)
+{
+	const GLuint restart = restartind(type);
+	size_t i = 0, c0, c1, r, c;
+	GLuint v;
+	if (width < 2 || height < 2)
+		return 0;
+	for (c0 = 0; c0 + 1 < width; c0 = c1) {
+		c1 = c0 + STRIP_BAND < width - 1 ? c0 + STRIP_BAND : width - 1;
+		for (r = 0; r + 1 < height; ++r) {
+			if (i)
+				putind(ind, i++, restart, type);
+			if (r % 2)
+				putind(ind, i++, (r + 1) * width + c0, type);
+			for (c = c0; c <= c1; ++c) {
+				v = r * width + c;
+				putind(ind, i++, r % 2 ? v + width : v, type);
+				putind(ind, i++, r % 2 ? v : v + width, type);
+			}
+		}
+	}
+	return i;
+}
+
+/*
+ * Average cache miss ratio: vertices transformed per triangle drawn, through
+ * a FIFO post-transform cache holding up to ACMR_MAX_CACHE vertices. mode is
+ * GL_TRIANGLES or GL_TRIANGLE_STRIP, the latter split by restart indices.
+ */
+double
+acmr(const void *const ind, const size_t n, const GLenum type,
+     const GLenum mode, size_t cache)
+{
+	const GLuint restart = restartind(type);
+	GLuint fifo[ACMR_MAX_CACHE], v, a = restart, b = restart;
+	size_t i, j, len = 0, head = 0, misses = 0, tris = 0;
+	if (cache > ACMR_MAX_CACHE)
+		cache = ACMR_MAX_CACHE;
+	for (i = 0; i < n; ++i) {
+		v = getind(ind, i, type);
+		if (mode == GL_TRIANGLE_STRIP && v == restart) {
+			a = b = restart;
+			continue;
+		}
+		for (j = 0; j < len && fifo[j] != v; ++j)
+			;
+		if (j == len) {
+			++misses;
+			if (len < cache)
+				++len;
+			fifo[head] = v;
+			head = (head + 1) % cache;
+		}
+		if (mode == GL_TRIANGLES)
+			tris += i % 3 == 2;
+		else if (a != restart && a != b && b != v && a != v)
+			++tris;
+		a = b;
+		b = v;
+	}
+	return tris ? (double) misses / tris : 0.0;
+}
+
+GLfloat *
+initclothvert(const size_t width, const size_t height, size_t *asize,
+              const uint64_t seed)
+{
+	const size_t numvert = width * height;
+	size_t i;
+	GLfloat *a;
+	const GLfloat side = fminf(2.0f / (width - 0.5f), 4.0f / (height - 1) * SQRT3);
+	const GLfloat dy = side * SQRT3 / 2.0f;
+	const GLfloat offy = height * dy / 2;
+	*asize = 3 * numvert;
+	if ((a = malloc(*asize * sizeof(GLfloat)))) {
+		for (i = 0; i < numvert; ++i) {
+			a[3 * i] = (i % width) * side - 1.0f;
+			if (i / width % 2)
+				a[3 * i] += side / 2;
+			a[3 * i + 1] = (i / width) * dy - offy;
+			a[3 * i + 2] = (float) (rng(seed ^ RNG_HEIGHTS, i) % 32) / 256 -1.0f;
+		}
+	}
+	return a;
+}
+
+GLuint *
+initclothtri(const size_t width, const size_t height, size_t *asize)
+{
+	const size_t numtri = 2 * (width - 1) * (height - 1);
+	const size_t numvert = width * height;
+	GLuint *a;
+	size_t i, j = 0;
+	if (width >= 2 && height >= 2) {
+		*asize = 3 * numtri;
+		if (!(a = malloc(*asize * sizeof(GLuint))))
+			return NULL;
+		for (i = 0; i + width < numvert; ++i) {
+			if (!((i + 1) % width))
+				continue;
+			if (i / width % 2) {
+				a[j++] = i;
+				a[j++] = i + width;
+				a[j++] = i + width + 1;
+				a[j++] = i;
+				a[j++] = i + width + 1;
+				a[j++] = i + 1;
+			} else {
+				a[j++] = i;
+				a[j++] = i + width;
+				a[j++] = i + 1;
+				a[j++] = i + 1;
+				a[j++] = i + width;
+				a[j++] = i + width + 1;
+			}
+		}
+		return a;
+	} else {
+		return NULL;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+size_t numvert(const size_t width, const size_t height);
+size_t numind(const size_t width, const size_t height);
+size_t numstrip(const size_t width, const size_t height);
+GLenum indtype(const size_t width, const size_t height);
+size_t indsize(const GLenum type);
+GLuint restartind(const GLenum type);
+void latticedims(const size_t width, const size_t height, GLfloat *const side,
+                 GLfloat *const dy, GLfloat *const offy);
+void initvert(const size_t width, const size_t height, GLfloat v[]);
+void initxy(const size_t width, const size_t height, GLfloat v[]);
+void initind(const size_t width, const size_t height, GLuint ind[]);
+size_t initstrip(const size_t width, const size_t height, void *const ind,
+                 const GLenum type);
+double acmr(const void *const ind, const size_t n, const GLenum type,
+            const GLenum mode, size_t cache);
+GLfloat *initclothvert(const size_t width, const size_t height, size_t *asize,
+                       const uint64_t seed);
+GLuint *initclothtri(const size_t width, const size_t height, size_t *asize);
+
+#endif
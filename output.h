@@ -0,0 +1,39 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define OUTPUT_MAX_MONITORS 16
+
+/* the part of the output one monitor shows, with y going down as in X */
+struct monitor {
+	int x, y, width, height;
+};
+
+/*
+ * Where graphics() draws. Opening an output leaves its OpenGL context current,
+ * GLEW initialized and the framebuffer to draw into bound. After present(),
+ * fbo holds the frame just presented (0 for a window). visible() is NULL for
+ * outputs that are always shown; with block set, a hidden output may wait a
+ * little for that to change.
+ *
+ * Only the monitors' areas get drawn. visible() may change them, and the size
+ * of the output with them; layout counts those changes.
+ */
+struct output {
+	int width, height;
+	GLuint fbo;
+	int nmonitors;
+	struct monitor monitors[OUTPUT_MAX_MONITORS];
+	unsigned long layout;
+	void (*present)(struct output *const o);
+	int (*visible)(struct output *const o, const int block);
+	void (*close)(struct output *const o);
+	void *data;
+};
+
+int mkeglout(struct output *const o, const int width, const int height,
+             int msaa);
+
+#endif
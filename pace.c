@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <time.h>
+
+#include "pace.h"
+
+#define NSEC 1000000000LL
+/* falling further behind than this many periods drops them */
+#define PACE_MAX_LAG 4
+
+static long long
+tons(const struct timespec t)
+{
+	return t.tv_sec * NSEC + t.tv_nsec;
+}
+
+static struct timespec
+tots(const long long ns)
+{
+	struct timespec t;
+	t.tv_sec = ns / NSEC;
+	t.tv_nsec = ns % NSEC;
+	return t;
+}
+
+/* seconds on CLOCK_MONOTONIC */
+double
+monotime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / (double) NSEC;
+}
+
+/* seconds of CPU used by the whole process, every thread counted */
+double
+proctime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec / (double) NSEC;
+}
+
+void
+mkpace(struct pace *const p, const double period, const int catchup)
+{
+	p->period = period * NSEC;
+	if (p->period < 1)
+		p->period = 1;
+	p->catchup = catchup;
+	clock_gettime(CLOCK_MONOTONIC, &p->next);
+}
+
+/*
+ * Sleeps until the next deadline. Deadlines are absolute, so the time spent
+ * between two calls does not accumulate into drift. A caller that ran late
+ * either gets the missed periods back to back (catchup, up to PACE_MAX_LAG of
+ * them) or skips them and stays in phase with the original deadlines.
+ */
+void
+pacewait(struct pace *const p)
+{
+	struct timespec now;
+	long long next = tons(p->next) + p->period;
+	long long late;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	late = tons(now) - next;
+	if (late > 0) {
+		if (!p->catchup)
+			next += (late / p->period + 1) * p->period;
+		else if (late > PACE_MAX_LAG * p->period)
+			next = tons(now);
+	}
+	p->next = tots(next);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->next, NULL) == EINTR)
+		;
+}
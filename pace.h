@@ -0,0 +1,18 @@
+#ifndef PACE_H
+#define PACE_H
+
+#include <time.h>
+
+/* absolute deadlines on CLOCK_MONOTONIC, one every period */
+struct pace {
+	struct timespec next;
+	long long period;
+	int catchup;
+};
+
+double monotime(void);
+double proctime(void);
+void mkpace(struct pace *const p, const double period, const int catchup);
+void pacewait(struct pace *const p);
+
+#endif
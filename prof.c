@@ -0,0 +1,141 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pace.h"
+#include "prof.h"
+
+static void
+histadd(struct profhist *const h, const double ms)
+{
+	h->ms[h->n++ % PROF_SAMPLES] = ms;
+}
+
+static int
+cmpdouble(const void *a, const void *b)
+{
+	const double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/* nearest rank percentiles of the window, sorted in a copy */
+static void
+histline(FILE *const f, const char *const name, const char *const clock,
+         const struct profhist *const h)
+{
+	const size_t n = h->n < PROF_SAMPLES ? h->n : PROF_SAMPLES;
+	double sorted[PROF_SAMPLES], mean = 0.0;
+	size_t i;
+	if (!n)
+		return;
+	memcpy(sorted, h->ms, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), cmpdouble);
+	for (i = 0; i < n; ++i)
+		mean += sorted[i];
+	fprintf(f, "%s,%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f\n", name, clock, h->n,
+	        mean / n, sorted[(n - 1) * 50 / 100], sorted[(n - 1) * 95 / 100],
+	        sorted[(n - 1) * 99 / 100], sorted[n - 1]);
+}
+
+void
+mkprof(struct prof *const p)
+{
+	size_t s;
+	memset(p, 0, sizeof(*p));
+	p->cur = -1;
+	p->timer = 1;
+	for (s = 0; s < PROF_MAX_SECTIONS && p->timer; ++s)
+		p->timer = mkgputimer(&p->gputime[s]);
+	p->framestart = monotime();
+}
+
+/*
+ * Returns the new section's number, or -1 when there are too many. Every
+ * other function takes a NULL profiler or a -1 section and does nothing.
+ */
+int
+profsection(struct prof *const p, const char *const name)
+{
+	if (!p || p->nsections == PROF_MAX_SECTIONS)
+		return -1;
+	p->names[p->nsections] = name;
+	return p->nsections++;
+}
+
+/* ends the open section, if any, and starts timing this one */
+void
+profbegin(struct prof *const p, const int section)
+{
+	if (!p)
+		return;
+	profend(p);
+	if (section < 0)
+		return;
+	p->cur = section;
+	/* llvmpipe times a query begun before any work from zero, so skip frame 0 */
+	if (p->timer && p->frame.n)
+		gputimerbegin(&p->gputime[section]);
+	p->start = monotime();
+}
+
+void
+profend(struct prof *const p)
+{
+	if (!p || p->cur < 0)
+		return;
+	histadd(&p->cpu[p->cur], (monotime() - p->start) * 1e3);
+	if (p->timer)
+		gputimerend(&p->gputime[p->cur]);
+	p->cur = -1;
+}
+
+/* a CPU sample timed elsewhere, say on another thread */
+void
+profadd(struct prof *const p, const int section, const double ms)
+{
+	if (p && section >= 0)
+		histadd(&p->cpu[section], ms);
+}
+
+/*
+ * Closes the frame and collects whatever of the GPU times from GPUTIMER_LAG
+ * frames ago the GPU has finished.
+ */
+void
+profframe(struct prof *const p)
+{
+	const double now = monotime();
+	double ms;
+	size_t s;
+	if (!p)
+		return;
+	profend(p);
+	histadd(&p->frame, (now - p->framestart) * 1e3);
+	p->framestart = now;
+	for (s = 0; p->timer && s < p->nsections; ++s)
+		if (gputimerframe(&p->gputime[s], &ms))
+			histadd(&p->gpu[s], ms);
+}
+
+void
+profdump(struct prof *const p, FILE *const f)
+{
+	size_t s;
+	fputs("section,clock,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n", f);
+	histline(f, "frame", "cpu", &p->frame);
+	for (s = 0; s < p->nsections; ++s) {
+		histline(f, p->names[s], "cpu", &p->cpu[s]);
+		histline(f, p->names[s], "gpu", &p->gpu[s]);
+	}
+	fflush(f);
+}
+
+void
+freeprof(struct prof *const p)
+{
+	size_t s;
+	profend(p);
+	for (s = 0; p->timer && s < PROF_MAX_SECTIONS; ++s)
+		freegputimer(&p->gputime[s]);
+}
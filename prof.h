@@ -0,0 +1,42 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "gputimer.h"
+
+#define PROF_MAX_SECTIONS 8
+/* rolling window, per section and clock */
+#define PROF_SAMPLES 1024
+
+struct profhist {
+	double ms[PROF_SAMPLES];
+	size_t n;
+};
+
+/*
+ * Frame profiler. Every section is timed on CLOCK_MONOTONIC and, when timer
+ * queries are there, on the GPU, each through a gputimer of its own.
+ * Sections are sequential, beginning one ends the last.
+ */
+struct prof {
+	const char *names[PROF_MAX_SECTIONS];
+	size_t nsections;
+	struct profhist cpu[PROF_MAX_SECTIONS], gpu[PROF_MAX_SECTIONS];
+	struct profhist frame;
+	struct gputimer gputime[PROF_MAX_SECTIONS];
+	int timer, cur;
+	double start, framestart;
+};
+
+void mkprof(struct prof *const p);
+int profsection(struct prof *const p, const char *const name);
+void profbegin(struct prof *const p, const int section);
+void profend(struct prof *const p);
+void profadd(struct prof *const p, const int section, const double ms);
+void profframe(struct prof *const p);
+void profdump(struct prof *const p, FILE *const f);
+void freeprof(struct prof *const p);
+
+#endif
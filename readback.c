@@ -0,0 +1,102 @@
+#include "readback.h"
+
+/* stride is in bytes and a multiple of 4, rows may be padded */
+int
+mkreadback(struct readback *const r, const int width, const int height,
+           const size_t stride)
+{
+	int i;
+	r->width = width;
+	r->height = height;
+	r->stride = stride;
+	r->size = stride * height;
+	r->first = r->count = 0;
+	glGenBuffers(READBACK_SLOTS, r->pbo);
+	for (i = 0; i < READBACK_SLOTS; ++i) {
+		r->fence[i] = NULL;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, r->size, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+static int
+signaled(const GLsync fence, const int wait)
+{
+	GLenum s;
+	if (!wait)
+		return glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED;
+	while ((s = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)) == GL_TIMEOUT_EXPIRED)
+		;
+	return s != GL_WAIT_FAILED;
+}
+
+static void
+drop(struct readback *const r)
+{
+	glDeleteSync(r->fence[r->first]);
+	r->fence[r->first] = NULL;
+	r->first = (r->first + 1) % READBACK_SLOTS;
+	--r->count;
+}
+
+/*
+ * Queues a read of the bound read framebuffer. With every slot taken, the
+ * oldest frame is dropped rather than waited for.
+ */
+void
+readbackpush(struct readback *const r)
+{
+	int slot;
+	if (r->count == READBACK_SLOTS)
+		drop(r);
+	slot = (r->first + r->count++) % READBACK_SLOTS;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo[slot]);
+	glPixelStorei(GL_PACK_ROW_LENGTH, r->stride / 4);
+	glReadPixels(0, 0, r->width, r->height, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	r->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	/* or nothing tells the driver to start on it before the next frame */
+	glFlush();
+}
+
+/* drops the finished frames older than the newest finished one */
+void
+readbackskip(struct readback *const r)
+{
+	while (r->count > 1 && signaled(r->fence[(r->first + 1) % READBACK_SLOTS], 0))
+		drop(r);
+}
+
+/*
+ * Maps the oldest frame, NULL when there is none or, unless asked to wait,
+ * when it is not read yet. Every map that succeeded needs an unmap.
+ */
+const void *
+readbackmap(struct readback *const r, const int wait)
+{
+	if (!r->count || !signaled(r->fence[r->first], wait))
+		return NULL;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo[r->first]);
+	return glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, r->size, GL_MAP_READ_BIT);
+}
+
+/* done with the oldest frame, which leaves the queue */
+void
+readbackunmap(struct readback *const r)
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r->pbo[r->first]);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	drop(r);
+}
+
+void
+freereadback(struct readback *const r)
+{
+	while (r->count)
+		drop(r);
+	glDeleteBuffers(READBACK_SLOTS, r->pbo);
+}
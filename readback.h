@@ -0,0 +1,33 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <stddef.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define READBACK_SLOTS 3
+
+/*
+ * Asynchronous frame readback. Each frame is read as BGRA bytes into its own
+ * pixel pack buffer behind a fence, and only mapped once that fence has
+ * signaled, a frame or two later, so the GPU never has to catch up with the
+ * CPU in between. Frames come out in the order they went in.
+ */
+struct readback {
+	GLuint pbo[READBACK_SLOTS];
+	GLsync fence[READBACK_SLOTS];
+	int width, height;
+	size_t stride, size;
+	int first, count;
+};
+
+int mkreadback(struct readback *const r, const int width, const int height,
+               const size_t stride);
+void readbackpush(struct readback *const r);
+void readbackskip(struct readback *const r);
+const void *readbackmap(struct readback *const r, const int wait);
+void readbackunmap(struct readback *const r);
+void freereadback(struct readback *const r);
+
+#endif
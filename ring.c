@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "ring.h"
+
+#define RING_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+/*
+ * Leaves the buffer bound to GL_ARRAY_BUFFER with every slot holding a copy
+ * of staging, which must stay valid: it is what gets uploaded when there is
+ * no persistent mapping. Nothing is left to free when it fails.
+ */
+int
+mkring(struct ring *const r, const size_t size, void *const staging)
+{
+	int i;
+	r->size = size;
+	r->staging = staging;
+	r->map = NULL;
+	r->slot = 0;
+	for (i = 0; i < RING_SLOTS; ++i)
+		r->fence[i] = NULL;
+	/* an error left over from before is not the ring's */
+	while (glGetError() != GL_NO_ERROR)
+		;
+	glGenBuffers(1, &r->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+	if (GLEW_ARB_buffer_storage || GLEW_VERSION_4_4) {
+		glBufferStorage(GL_ARRAY_BUFFER, RING_SLOTS * size, NULL, RING_FLAGS);
+		if (glGetError() == GL_NO_ERROR)
+			r->map = glMapBufferRange(GL_ARRAY_BUFFER, 0, RING_SLOTS * size, RING_FLAGS);
+	}
+	if (r->map) {
+		for (i = 0; i < RING_SLOTS; ++i)
+			memcpy(r->map + i * size, staging, size);
+		return 1;
+	}
+	/* storage may be immutable already, so start over */
+	while (glGetError() != GL_NO_ERROR)
+		;
+	glDeleteBuffers(1, &r->vbo);
+	glGenBuffers(1, &r->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+	glBufferData(GL_ARRAY_BUFFER, size, staging, GL_STREAM_DRAW);
+	if (glGetError() == GL_NO_ERROR)
+		return 1;
+	glDeleteBuffers(1, &r->vbo);
+	return 0;
+}
+
+/* once the GPU is through with what the slot held */
+static void
+slotwait(struct ring *const r, const int slot)
+{
+	GLsync *const fence = &r->fence[slot];
+	if (!*fence)
+		return;
+	while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		;
+	glDeleteSync(*fence);
+	*fence = NULL;
+}
+
+/* where to write this frame's data, the slots taken in turn */
+void *
+ringbegin(struct ring *const r)
+{
+	if (!r->map)
+		return r->staging;
+	r->slot = (r->slot + 1) % RING_SLOTS;
+	slotwait(r, r->slot);
+	return r->map + r->slot * r->size;
+}
+
+/*
+ * Makes data, what ringbegin() returned or a slot handed around by the
+ * caller, the one drawn from until the next call. Returns its byte offset in
+ * the buffer, uploading it first if there is no persistent mapping.
+ */
+GLintptr
+ringuse(struct ring *const r, const void *const data)
+{
+	if (r->map) {
+		r->slot = ((const char *) data - r->map) / r->size;
+		return r->slot * r->size;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+	glBufferData(GL_ARRAY_BUFFER, r->size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, r->size, data);
+	return 0;
+}
+
+/* before handing the slot holding data over to be written */
+void
+ringwait(struct ring *const r, const void *const data)
+{
+	if (r->map && data)
+		slotwait(r, ((const char *) data - r->map) / r->size);
+}
+
+/* before writing any slot at all; returns the first one, or NULL unmapped */
+void *
+ringidle(struct ring *const r)
+{
+	int i;
+	if (!r->map)
+		return NULL;
+	for (i = 0; i < RING_SLOTS; ++i)
+		slotwait(r, i);
+	return r->map;
+}
+
+/* to be called once the draws reading the current slot are submitted */
+void
+ringfence(struct ring *const r)
+{
+	if (!r->map)
+		return;
+	if (r->fence[r->slot])
+		glDeleteSync(r->fence[r->slot]);
+	r->fence[r->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void
+freering(struct ring *const r)
+{
+	int i;
+	for (i = 0; i < RING_SLOTS; ++i) {
+		if (r->fence[i])
+			glDeleteSync(r->fence[i]);
+	}
+	if (r->map) {
+		glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	glDeleteBuffers(1, &r->vbo);
+}
@@ -0,0 +1,37 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define RING_SLOTS 3
+
+/*
+ * Streaming vertex buffer. With ARB_buffer_storage it holds RING_SLOTS
+ * copies of the data in one persistently mapped buffer, which any thread may
+ * write into, and a slot is only written again once the fence of the frame
+ * that last drew from it has signaled. Slots are either taken in turn with
+ * ringbegin(), or handed around by the caller, say as a triple buffer, who
+ * then waits with ringwait() before handing one over. Without it, the data
+ * is uploaded into an orphaned buffer.
+ */
+struct ring {
+	GLuint vbo;
+	size_t size;
+	void *staging;
+	char *map;
+	GLsync fence[RING_SLOTS];
+	int slot;
+};
+
+int mkring(struct ring *const r, const size_t size, void *const staging);
+void *ringbegin(struct ring *const r);
+GLintptr ringuse(struct ring *const r, const void *const data);
+void ringwait(struct ring *const r, const void *const data);
+void *ringidle(struct ring *const r);
+void ringfence(struct ring *const r);
+void freering(struct ring *const r);
+
+#endif
@@ -0,0 +1,15 @@
+#include "rng.h"
+
+/*
+ * Counter based generator: the n-th number of stream seed, which is the
+ * SplitMix64 finalizer of seed + (n + 1) * golden ratio. Needing no state,
+ * any thread can draw any number in any order and get the same result.
+ */
+uint64_t
+rng(const uint64_t seed, const uint64_t n)
+{
+	uint64_t z = seed + (n + 1) * 0x9e3779b97f4a7c15ull;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
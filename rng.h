@@ -0,0 +1,15 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/*
+ * Every use of a seed draws from a substream of its own, seed ^ RNG_*, so
+ * that, say, initial heights never repeat the first steps' kicks.
+ */
+#define RNG_KICKS 0x0ull
+#define RNG_HEIGHTS 0x6865696768747300ull
+
+uint64_t rng(const uint64_t seed, const uint64_t n);
+
+#endif
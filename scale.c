@@ -0,0 +1,207 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "scale.h"
+
+/* room for the largest factor at the output's size, rounded up */
+static int
+storage(struct scale *const s, const int width, const int height)
+{
+	GLint maxsamples;
+	s->width = width;
+	s->height = height;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxsamples);
+	if (s->samples > maxsamples)
+		s->samples = maxsamples;
+	glBindRenderbuffer(GL_RENDERBUFFER, s->rbo[0]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, s->samples, GL_RGBA8,
+	                                 ceil(s->max * width), ceil(s->max * height));
+	glBindRenderbuffer(GL_RENDERBUFFER, s->rbo[1]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, s->samples, GL_DEPTH_COMPONENT24,
+	                                 ceil(s->max * width), ceil(s->max * height));
+	glBindRenderbuffer(GL_RENDERBUFFER, s->rbo[2]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, ceil(s->max * width),
+	                      ceil(s->max * height));
+	return glGetError() == GL_NO_ERROR;
+}
+
+/* leaves the framebuffer to draw into as it was */
+int
+mkscale(struct scale *const s, const struct output *const o,
+        const float factor, const int samples, const double budget)
+{
+	GLint draw;
+	int complete;
+	s->samples = samples;
+	s->factor = s->max = factor;
+	s->budget = budget;
+	s->n = 0;
+	s->total = 0.0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+	glGenRenderbuffers(3, s->rbo);
+	glGenFramebuffers(1, &s->msfbo);
+	glGenFramebuffers(1, &s->fbo);
+	if (!storage(s, o->width, o->height)) {
+		fputs("Error: not enough memory to render scaled.\n", stderr);
+		goto errrbo;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, s->msfbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, s->rbo[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, s->rbo[1]);
+	complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, s->rbo[2]);
+	complete &= glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, draw);
+	if (!complete) {
+		fputs("Error: incomplete scaled framebuffer.\n", stderr);
+		goto errrbo;
+	}
+	s->timer = budget > 0.0 && mkgputimer(&s->gputime);
+	if (budget > 0.0 && !s->timer)
+		fputs("Warning: no timer queries, the render scale is fixed.\n", stderr);
+	return 1;
+
+	errrbo:
+	glDeleteFramebuffers(1, &s->fbo);
+	glDeleteFramebuffers(1, &s->msfbo);
+	glDeleteRenderbuffers(3, s->rbo);
+	return 0;
+}
+
+static int
+scaled(const struct scale *const s, const int v)
+{
+	return (int) (v * s->factor + 0.5f);
+}
+
+/*
+ * Binds the scaled framebuffer and returns the output as it is drawn there,
+ * or o itself without a scale. Storage follows changes in the output's size.
+ */
+struct output *
+scalebegin(struct scale *const s, struct output *const o)
+{
+	struct monitor *m;
+	int i;
+	if (!s)
+		return o;
+	if ((o->width != s->width || o->height != s->height)
+	    && !storage(s, o->width, o->height))
+		fputs("Warning: failed to resize the scaled framebuffer.\n", stderr);
+	s->view = *o;
+	s->view.width = scaled(s, o->width);
+	s->view.height = scaled(s, o->height);
+	s->view.fbo = s->fbo;
+	for (i = 0; i < o->nmonitors; ++i) {
+		m = &s->view.monitors[i];
+		m->x = scaled(s, o->monitors[i].x);
+		m->y = scaled(s, o->monitors[i].y);
+		m->width = scaled(s, o->monitors[i].x + o->monitors[i].width) - m->x;
+		m->height = scaled(s, o->monitors[i].y + o->monitors[i].height) - m->y;
+		if (m->width < 1)
+			m->width = 1;
+		if (m->height < 1)
+			m->height = 1;
+	}
+	if (s->timer)
+		gputimerbegin(&s->gputime);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &s->draw);
+	glBindFramebuffer(GL_FRAMEBUFFER, s->msfbo);
+	return &s->view;
+}
+
+/* resolves, then stretches each monitor back over the output's framebuffer */
+void
+scaleend(struct scale *const s, const struct output *const o)
+{
+	const struct monitor *m, *v;
+	int i;
+	if (!s)
+		return;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, s->msfbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, s->fbo);
+	glBlitFramebuffer(0, 0, s->view.width, s->view.height, 0, 0,
+	                  s->view.width, s->view.height, GL_COLOR_BUFFER_BIT,
+	                  GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, s->fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, s->draw);
+	for (i = 0; i < o->nmonitors; ++i) {
+		m = &o->monitors[i];
+		v = &s->view.monitors[i];
+		glBlitFramebuffer(v->x, s->view.height - v->y - v->height,
+		                  v->x + v->width, s->view.height - v->y,
+		                  m->x, o->height - m->y - m->height,
+		                  m->x + m->width, o->height - m->y,
+		                  GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, s->draw);
+	if (s->timer)
+		gputimerend(&s->gputime);
+}
+
+/*
+ * Every SCALE_PERIOD timed frames, moves the factor so that the GPU would
+ * take SCALE_AIM of the budget, taking its time to grow as pixels go with
+ * the square of the factor. Inside the band from SCALE_LOW to all of the
+ * budget, it stays put.
+ */
+static void
+adapt(struct scale *const s, const double ms)
+{
+	const double mean = (s->total += ms) / ++s->n;
+	float f;
+	if (s->n < SCALE_PERIOD)
+		return;
+	s->total = 0.0;
+	s->n = 0;
+	if (mean <= s->budget && mean >= SCALE_LOW * s->budget)
+		return;
+	f = s->factor * sqrt(SCALE_AIM * s->budget / mean);
+	f = floor(f * SCALE_STEPS + 0.5f) / SCALE_STEPS;
+	/* the storage is only as large as max, which may be under SCALE_MIN */
+	if (f < SCALE_MIN)
+		f = SCALE_MIN;
+	if (f > s->max)
+		f = s->max;
+	if (f != s->factor) {
+		fprintf(stderr, "Render scale %.3f, the GPU took %.2f ms.\n", f,
+		        mean);
+		s->factor = f;
+	}
+}
+
+/* collects the GPU time from GPUTIMER_LAG frames ago if it is there */
+void
+scaleframe(struct scale *const s)
+{
+	double ms;
+	if (s && s->timer && gputimerframe(&s->gputime, &ms))
+		adapt(s, ms);
+}
+
+/*
+ * Moves the largest factor and the samples per pixel, which reallocates the
+ * storage. A fixed factor is the largest one.
+ */
+int
+scalelimit(struct scale *const s, const float max, const int samples)
+{
+	s->max = max;
+	if (!s->timer || s->factor > max)
+		s->factor = max;
+	s->samples = samples;
+	s->total = 0.0;
+	s->n = 0;
+	return storage(s, s->width, s->height);
+}
+
+void
+freescale(struct scale *const s)
+{
+	if (s->timer)
+		freegputimer(&s->gputime);
+	glDeleteFramebuffers(1, &s->fbo);
+	glDeleteFramebuffers(1, &s->msfbo);
+	glDeleteRenderbuffers(3, s->rbo);
+}
@@ -0,0 +1,49 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "gputimer.h"
+#include "output.h"
+
+/* the smallest fraction an adaptive scale goes down to */
+#define SCALE_MIN 0.25f
+/* adaptive scales are multiples of 1 / SCALE_STEPS */
+#define SCALE_STEPS 32
+/* frames of GPU time averaged before adapting the scale */
+#define SCALE_PERIOD 16
+/* an adaptive scale grows back once the GPU takes less than that of the budget */
+#define SCALE_LOW 0.6
+/* and aims for that much of it */
+#define SCALE_AIM 0.8
+
+/*
+ * Render scaling. Frames are drawn into a multisampled framebuffer a factor
+ * smaller than the output, resolved, then stretched over each monitor with a
+ * linear filter. Given a budget in milliseconds, the factor follows the time
+ * the GPU spends between scalebegin() and scaleend(), up to the one asked
+ * for.
+ */
+struct scale {
+	int width, height, samples;
+	float factor, max;
+	double budget;
+	GLuint msfbo, fbo, rbo[3];
+	GLint draw;
+	struct output view;
+	struct gputimer gputime;
+	int timer;
+	double total;
+	int n;
+};
+
+int mkscale(struct scale *const s, const struct output *const o,
+            const float factor, const int samples, const double budget);
+struct output *scalebegin(struct scale *const s, struct output *const o);
+void scaleend(struct scale *const s, const struct output *const o);
+void scaleframe(struct scale *const s);
+int scalelimit(struct scale *const s, const float max, const int samples);
+void freescale(struct scale *const s);
+
+#endif
@@ -0,0 +1,486 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) && !defined(NOSIMD)
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(NOSIMD)
+#include <emmintrin.h>
+#endif
+
+#include "pace.h"
+#include "rng.h"
+#include "sim.h"
+
+/* set in triple.mid when it holds a snapshot the reader has not taken yet */
+#define FRESH 4
+
+float
+force(const size_t width, const size_t height,
+      const float zcur[], const float zprev[], const size_t i)
+{
+	const float k = WAVE_K;
+	const float p = WAVE_P;
+	const float f = WAVE_F;
+	const float z = zcur[i];
+	float a = 0.0f;
+
+	/* left */
+	if (i % width) {
+		a -= z - zcur[i - 1];
+		if (i / width % 2) {
+			/* row 0 is never odd */
+			a -= z - zcur[i - width];
+			if (i / width + 1 < height)
+				a -= z - zcur[i + width];
+		} else {
+			if (i > width)
+				a -= z - zcur[i - width - 1];
+			if (i / width + 1 < height)
+				a -= z - zcur[i + width - 1];
+		}
+	}
+
+	/* right */
+	if ((i + 1) % width) {
+		a -= z - zcur[i + 1];
+		if (i / width % 2) {
+			/* row 0 is never odd */
+			a -= z - zcur[i - width + 1];
+			if (i / width + 1 < height)
+				a -= z - zcur[i + width + 1];
+		} else {
+			if (i > width)
+				a -= z - zcur[i - width];
+			if (i / width + 1 < height)
+				a -= z - zcur[i + width];
+		}
+	}
+	return p * a - k * z - f * (z - zprev[i]);
+}
+
+/*
+ * Whether the first vertex of row r is kicked at a step, one time in
+ * KICK_ODDS. Every (step, row) pair has its own number of the seed's stream,
+ * so it does not matter which thread asks or when.
+ */
+int
+kick(const uint64_t seed, const uint64_t step, const size_t height,
+     const size_t r)
+{
+	return !(rng(seed ^ RNG_KICKS, step * height + r) % KICK_ODDS);
+}
+
+static void
+step(struct wave *const w, const size_t v)
+{
+	const float h = WAVE_H;
+	float f;
+	if (!(v % w->width) && kick(w->seed, w->step, w->height, v / w->width))
+		f = 2.0f;
+	else
+		f = force(w->width, w->height, w->cur, w->prev, v);
+	w->next[v] = 2 * w->cur[v] - w->prev[v] + f * h * h;
+}
+
+/*
+ * Interior of row r, columns [from, to). In an odd row the neighbours above
+ * and below sit at the same column and the next one, in an even row at the
+ * previous column and the same one, so a row only needs two base pointers.
+ * The arithmetic is done in the same order as force() so that every path
+ * gives bit-identical results.
+ */
+#if defined(__AVX2__) && !defined(NOSIMD)
+#define LANES 8
+#define VEC __m256
+#define LOAD _mm256_loadu_ps
+#define STORE _mm256_storeu_ps
+#define SET1 _mm256_set1_ps
+#define ADD _mm256_add_ps
+#define SUB _mm256_sub_ps
+#define MUL _mm256_mul_ps
+#elif defined(__SSE2__) && !defined(NOSIMD)
+#define LANES 4
+#define VEC __m128
+#define LOAD _mm_loadu_ps
+#define STORE _mm_storeu_ps
+#define SET1 _mm_set1_ps
+#define ADD _mm_add_ps
+#define SUB _mm_sub_ps
+#define MUL _mm_mul_ps
+#endif
+
+static void
+rowstep(struct wave *const w, const size_t r, size_t from, const size_t to)
+{
+	const size_t o = r * w->width;
+	const float *const c = w->cur + o;
+	const float *const u = c - w->width - !(r % 2);
+	const float *const d = c + w->width - !(r % 2);
+	const float *const pr = w->prev + o;
+	float *const nx = w->next + o;
+#ifdef LANES
+	const VEC zero = SET1(0.0f), two = SET1(2.0f), k = SET1(WAVE_K),
+	          p = SET1(WAVE_P), f = SET1(WAVE_F), h = SET1(WAVE_H);
+	for (; from + LANES <= to; from += LANES) {
+		const VEC z = LOAD(c + from);
+		const VEC zp = LOAD(pr + from);
+		VEC a = zero;
+		a = SUB(a, SUB(z, LOAD(c + from - 1)));
+		a = SUB(a, SUB(z, LOAD(u + from)));
+		a = SUB(a, SUB(z, LOAD(d + from)));
+		a = SUB(a, SUB(z, LOAD(c + from + 1)));
+		a = SUB(a, SUB(z, LOAD(u + from + 1)));
+		a = SUB(a, SUB(z, LOAD(d + from + 1)));
+		a = SUB(SUB(MUL(p, a), MUL(k, z)), MUL(f, SUB(z, zp)));
+		STORE(nx + from, ADD(SUB(MUL(two, z), zp), MUL(MUL(a, h), h)));
+	}
+#endif
+	for (; from < to; ++from) {
+		const float z = c[from];
+		float a = 0.0f;
+		a -= z - c[from - 1];
+		a -= z - u[from];
+		a -= z - d[from];
+		a -= z - c[from + 1];
+		a -= z - u[from + 1];
+		a -= z - d[from + 1];
+		a = WAVE_P * a - WAVE_K * z - WAVE_F * (z - pr[from]);
+		nx[from] = 2 * z - pr[from] + a * WAVE_H * WAVE_H;
+	}
+}
+
+/* rows [r0, r1) */
+static void
+band(struct wave *const w, const size_t r0, const size_t r1)
+{
+	const size_t width = w->width;
+	const size_t height = w->height;
+	size_t r, j;
+	for (r = r0; r < r1; ++r) {
+		if (!r || r + 1 == height || width < 3) {
+			for (j = 0; j < width; ++j)
+				step(w, r * width + j);
+		} else {
+			step(w, r * width);
+			rowstep(w, r, 1, width - 1);
+			step(w, r * width + width - 1);
+		}
+	}
+}
+
+static void
+rotate(struct wave *const w)
+{
+	float *const old = w->prev;
+	w->prev = w->cur;
+	w->cur = w->next;
+	w->next = old;
+	++w->step;
+}
+
+/*
+ * Computes the next step into w->next and rotates the three z arrays so that
+ * nothing has to be copied. Border vertices go through force(), everything
+ * else through the row kernel.
+ */
+void
+move(struct wave *const w)
+{
+	band(w, 0, w->height);
+	rotate(w);
+}
+
+/*
+ * Carries a z field over to a grid of another size, bilinearly, with the
+ * corners staying on the corners.
+ */
+void
+resample(const float src[], const size_t swidth, const size_t sheight,
+         float dst[], const size_t dwidth, const size_t dheight)
+{
+	size_t i, j, r, c;
+	float u, v, top, bottom;
+	for (i = 0; i < dheight; ++i) {
+		v = (float) i * (sheight - 1) / (dheight - 1);
+		r = v < sheight - 1 ? (size_t) v : sheight - 2;
+		v -= r;
+		for (j = 0; j < dwidth; ++j) {
+			u = (float) j * (swidth - 1) / (dwidth - 1);
+			c = u < swidth - 1 ? (size_t) u : swidth - 2;
+			u -= c;
+			top = src[r * swidth + c] * (1 - u) + src[r * swidth + c + 1] * u;
+			bottom = src[(r + 1) * swidth + c] * (1 - u)
+			         + src[(r + 1) * swidth + c + 1] * u;
+			dst[i * dwidth + j] = top * (1 - v) + bottom * v;
+		}
+	}
+}
+
+static void
+poolband(struct pool *const p, const size_t t)
+{
+	const size_t h = p->w->height;
+	band(p->w, t * h / p->nthreads, (t + 1) * h / p->nthreads);
+}
+
+/*
+ * Bands only write their own rows of w->next. The rows just outside a band
+ * are its halo and are read straight from w->cur, which nobody writes during
+ * a step; the two barriers are all the synchronization there is.
+ */
+static void *
+worker(void *arg)
+{
+	struct poolarg *const a = arg;
+	struct pool *const p = a->pool;
+	/* wait until mkpool() knows how many threads it got */
+	pthread_mutex_lock(&p->lock);
+	pthread_mutex_unlock(&p->lock);
+	if (p->quit)
+		return NULL;
+	for (;;) {
+		pthread_barrier_wait(&p->start);
+		if (p->quit)
+			return NULL;
+		poolband(p, a->t);
+		pthread_barrier_wait(&p->done);
+	}
+}
+
+/*
+ * Returns 0 if no worker could be started. The pool is usable either way and
+ * simply runs with fewer threads than asked for.
+ */
+int
+mkpool(struct pool *const p, struct wave *const w, size_t nthreads)
+{
+	size_t t;
+	if (nthreads > w->height / POOL_MIN_ROWS)
+		nthreads = w->height / POOL_MIN_ROWS;
+	if (nthreads > POOL_MAX_THREADS)
+		nthreads = POOL_MAX_THREADS;
+	if (!nthreads)
+		nthreads = 1;
+	p->w = w;
+	p->nthreads = 1;
+	p->quit = 0;
+	if (nthreads == 1)
+		return 1;
+	if (pthread_mutex_init(&p->lock, NULL))
+		return 0;
+	pthread_mutex_lock(&p->lock);
+	for (t = 1; t < nthreads; ++t) {
+		p->args[t].pool = p;
+		p->args[t].t = t;
+		if (pthread_create(&p->threads[t], NULL, worker, &p->args[t]))
+			break;
+	}
+	p->nthreads = t;
+	if (t == 1)
+		goto errbarrier;
+	if (pthread_barrier_init(&p->start, NULL, t))
+		goto errbarrier;
+	if (pthread_barrier_init(&p->done, NULL, t)) {
+		pthread_barrier_destroy(&p->start);
+		goto errbarrier;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return 1;
+
+	errbarrier:
+	p->quit = 1;
+	pthread_mutex_unlock(&p->lock);
+	while (--t)
+		pthread_join(p->threads[t], NULL);
+	pthread_mutex_destroy(&p->lock);
+	p->nthreads = 1;
+	return 0;
+}
+
+/* same as move() on p->w, with the rows split between the threads */
+void
+poolmove(struct pool *const p)
+{
+	if (p->nthreads == 1) {
+		move(p->w);
+		return;
+	}
+	pthread_barrier_wait(&p->start);
+	poolband(p, 0);
+	pthread_barrier_wait(&p->done);
+	rotate(p->w);
+}
+
+void
+freepool(struct pool *const p)
+{
+	size_t t;
+	if (p->nthreads == 1)
+		return;
+	p->quit = 1;
+	pthread_barrier_wait(&p->start);
+	for (t = 1; t < p->nthreads; ++t)
+		pthread_join(p->threads[t], NULL);
+	pthread_barrier_destroy(&p->done);
+	pthread_barrier_destroy(&p->start);
+	pthread_mutex_destroy(&p->lock);
+	p->nthreads = 1;
+}
+
+void
+mktriple(struct triple *const t, float *const a, float *const b,
+         float *const c)
+{
+	t->buf[0] = a;
+	t->buf[1] = b;
+	t->buf[2] = c;
+	t->back = 0;
+	t->mid = 1;
+	t->front = 2;
+}
+
+/* hands the back buffer over to the reader, returns the one to fill next */
+float *
+triplepub(struct triple *const t)
+{
+	t->back = __atomic_exchange_n(&t->mid, t->back | FRESH, __ATOMIC_ACQ_REL) & ~FRESH;
+	return t->buf[t->back];
+}
+
+/* whether triplelatest() would return a new buffer, which only it clears */
+int
+triplefresh(const struct triple *const t)
+{
+	return __atomic_load_n(&t->mid, __ATOMIC_RELAXED) & FRESH;
+}
+
+/* never blocks; returns the same buffer again if nothing new came in */
+const float *
+triplelatest(struct triple *const t)
+{
+	if (__atomic_load_n(&t->mid, __ATOMIC_RELAXED) & FRESH)
+		t->front = __atomic_exchange_n(&t->mid, t->front, __ATOMIC_ACQ_REL) & ~FRESH;
+	return t->buf[t->front];
+}
+
+/* one step, published; returns the buffer to fill next */
+static float *
+simstep(struct sim *const s, float *const back)
+{
+	const struct wave *const w = s->pool->w;
+	const double t = monotime();
+	poolmove(s->pool);
+	__atomic_add_fetch(&s->movens, (unsigned long long) ((monotime() - t) * 1e9), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&s->moves, 1, __ATOMIC_RELEASE);
+	memcpy(back, w->cur, w->width * w->height * sizeof(float));
+	return triplepub(&s->snaps);
+}
+
+static void *
+simloop(void *arg)
+{
+	struct sim *const s = arg;
+	float *back = s->snaps.buf[s->snaps.back];
+	struct pace pace;
+	int quit = 0;
+	mkpace(&pace, s->dt, 1);
+	while (!quit) {
+		back = simstep(s, back);
+		pacewait(&pace);
+		pthread_mutex_lock(&s->lock);
+		if (s->paused && !s->quit) {
+			s->asleep = 1;
+			while (s->paused && !s->quit)
+				pthread_cond_wait(&s->wake, &s->lock);
+			s->asleep = 0;
+			/* simpause() stepped in between */
+			back = s->snaps.buf[s->snaps.back];
+			/* the rest of the time spent paused is not to be caught up */
+			mkpace(&pace, s->dt, 1);
+		}
+		quit = s->quit;
+		pthread_mutex_unlock(&s->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Starts stepping the pool's wave every dt seconds on a thread of its own.
+ * snaps holds the three snapshots, 3 * width * height floats. The wave must
+ * not be touched until freesim().
+ */
+int
+mksim(struct sim *const s, struct pool *const pool, float snaps[],
+      const double dt)
+{
+	const size_t n = pool->w->width * pool->w->height;
+	size_t i;
+	s->pool = pool;
+	s->dt = dt;
+	s->paused = 0;
+	s->asleep = 0;
+	s->quit = 0;
+	s->movens = 0;
+	s->moves = 0;
+	for (i = 0; i < 3; ++i)
+		memcpy(snaps + i * n, pool->w->cur, n * sizeof(float));
+	mktriple(&s->snaps, snaps, snaps + n, snaps + 2 * n);
+	if (pthread_mutex_init(&s->lock, NULL))
+		goto errlock;
+	if (pthread_cond_init(&s->wake, NULL))
+		goto errwake;
+	if (pthread_create(&s->thread, NULL, simloop, s))
+		goto errthread;
+	return 1;
+
+	errthread:
+	pthread_cond_destroy(&s->wake);
+	errwake:
+	pthread_mutex_destroy(&s->lock);
+	errlock:
+	return 0;
+}
+
+/*
+ * A paused simulation finishes its current step and then sleeps. Resuming
+ * one that slept catches up with a step right away, published before this
+ * returns, so that the first frame back has moved on.
+ */
+void
+simpause(struct sim *const s, const int paused)
+{
+	pthread_mutex_lock(&s->lock);
+	if (!paused && s->asleep)
+		simstep(s, s->snaps.buf[s->snaps.back]);
+	s->paused = paused;
+	pthread_cond_signal(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+}
+
+int
+simfresh(struct sim *const s)
+{
+	return triplefresh(&s->snaps);
+}
+
+/* latest complete z snapshot */
+const float *
+simlatest(struct sim *const s)
+{
+	return triplelatest(&s->snaps);
+}
+
+void
+freesim(struct sim *const s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->quit = 1;
+	pthread_cond_signal(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+	pthread_cond_destroy(&s->wake);
+	pthread_mutex_destroy(&s->lock);
+}
@@ -0,0 +1,89 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* spring back to rest, pull of the neighbours, friction and time step */
+#define WAVE_K 0.125f
+#define WAVE_P 0.1f
+#define WAVE_F 0.5f
+#define WAVE_H 0.1f
+/* one first column vertex in that many gets kicked at each step */
+#define KICK_ODDS 128
+
+#define POOL_MAX_THREADS 64
+#define POOL_MIN_ROWS 16
+
+/*
+ * The z field is simulated on its own; XY never change after initvert().
+ * The kicks only depend on seed and the number of steps taken so far.
+ */
+struct wave {
+	size_t width, height;
+	float *cur, *prev, *next;
+	uint64_t seed, step;
+};
+
+struct pool;
+
+struct poolarg {
+	struct pool *pool;
+	size_t t;
+};
+
+/* persistent workers stepping a wave in bands of rows, one band each */
+struct pool {
+	struct wave *w;
+	size_t nthreads;
+	pthread_t threads[POOL_MAX_THREADS];
+	struct poolarg args[POOL_MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_barrier_t start, done;
+	int quit;
+};
+
+/* lock-free triple buffer, one writer and one reader */
+struct triple {
+	float *buf[3];
+	int back, mid, front;
+};
+
+/* a thread stepping a wave at a fixed rate and publishing its z field */
+struct sim {
+	struct pool *pool;
+	struct triple snaps;
+	double dt;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int paused, asleep, quit;
+	/* time spent in poolmove() and number of calls, atomically added to */
+	unsigned long long movens;
+	unsigned long moves;
+};
+
+float force(const size_t width, const size_t height,
+            const float zcur[], const float zprev[], const size_t i);
+int kick(const uint64_t seed, const uint64_t step, const size_t height,
+         const size_t r);
+void move(struct wave *const w);
+void resample(const float src[], const size_t swidth, const size_t sheight,
+              float dst[], const size_t dwidth, const size_t dheight);
+int mkpool(struct pool *const p, struct wave *const w, size_t nthreads);
+void poolmove(struct pool *const p);
+void freepool(struct pool *const p);
+void mktriple(struct triple *const t, float *const a, float *const b,
+              float *const c);
+float *triplepub(struct triple *const t);
+int triplefresh(const struct triple *const t);
+const float *triplelatest(struct triple *const t);
+int mksim(struct sim *const s, struct pool *const pool, float snaps[],
+          const double dt);
+void simpause(struct sim *const s, const int paused);
+int simfresh(struct sim *const s);
+const float *simlatest(struct sim *const s);
+void freesim(struct sim *const s);
+
+#endif
@@ -0,0 +1,90 @@
+#!/bin/sh
+# Runs glx against Xvfb and checks what only shows with an X server: that it
+# pauses while a fullscreen window covers the root window and resumes after,
+# and that -P draws into the background pixmap, through MIT-SHM and without.
+# Needs Xvfb, and glx and xprobe built (make xcheck does both).
+
+XDISPLAY=${XDISPLAY:-:97}
+LOG=$(mktemp)
+fails=0
+
+# starts Xvfb with any extra arguments and waits for it to take clients
+startx() {
+	Xvfb "$XDISPLAY" -screen 0 640x360x24 -nolisten tcp "$@" >/dev/null 2>&1 &
+	xvfb=$!
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		DISPLAY=$XDISPLAY ./xprobe ping 2>/dev/null && return 0
+		sleep 0.5
+	done
+	echo "FAILED: Xvfb $* did not start"
+	exit 1
+}
+
+stopx() {
+	kill $xvfb 2>/dev/null
+	wait $xvfb 2>/dev/null
+}
+
+# runs glx with the given arguments in the background
+startglx() {
+	DISPLAY=$XDISPLAY ./glx "$@" >"$LOG" 2>&1 &
+	glx=$!
+	sleep 2
+}
+
+stopglx() {
+	kill $glx 2>/dev/null
+	wait $glx 2>/dev/null
+}
+
+expect() {
+	if grep -q "$1" "$LOG"; then
+		echo "ok: $2"
+	else
+		echo "FAILED: $2"
+		fails=$((fails + 1))
+	fi
+}
+
+pausecheck() {
+	startglx "$@"
+	DISPLAY=$XDISPLAY ./xprobe cover 2 >/dev/null
+	stopglx
+	expect "Root window hidden, pausing." "glx $* pauses when covered"
+	expect "Root window visible, resuming." "glx $* resumes when uncovered"
+}
+
+# -P, while it runs, leaves frames in the pixmap other clients find
+bkgcheck() {
+	startglx -P
+	if DISPLAY=$XDISPLAY ./xprobe bkg >/dev/null; then
+		echo "ok: glx -P draws into the background pixmap ($1)"
+	else
+		echo "FAILED: glx -P draws into the background pixmap ($1)"
+		fails=$((fails + 1))
+	fi
+	stopglx
+}
+
+if ! command -v Xvfb >/dev/null; then
+	echo "FAILED: no Xvfb to run against"
+	exit 1
+fi
+
+startx
+pausecheck
+pausecheck -P
+bkgcheck "MIT-SHM"
+if grep -q "no MIT-SHM" "$LOG"; then
+	echo "FAILED: glx -P uses MIT-SHM"
+	fails=$((fails + 1))
+fi
+stopx
+
+startx -extension MIT-SHM
+bkgcheck "XPutImage"
+expect "no MIT-SHM, frames go through the X socket" "glx -P falls back without MIT-SHM"
+stopx
+
+rm -f "$LOG"
+[ $fails -eq 0 ]
@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+/*
+ * Pokes the X server the way other clients would, for xcheck.sh. ping only
+ * succeeds once the server takes clients. cover maps a window over the whole
+ * screen, as a fullscreen client would, holds it there for a while, then
+ * unmaps it and holds again. bkg succeeds if _XROOTPMAP_ID names a pixmap
+ * with something drawn on it, more than one colour.
+ */
+
+static int
+cover(Display *const disp, const unsigned int seconds)
+{
+	const int scr = DefaultScreen(disp);
+	XSetWindowAttributes attr;
+	Window win;
+	/* nothing manages windows under Xvfb, so place it ourselves */
+	attr.override_redirect = True;
+	attr.background_pixel = BlackPixel(disp, scr);
+	win = XCreateWindow(disp, RootWindow(disp, scr), 0, 0,
+	                    DisplayWidth(disp, scr), DisplayHeight(disp, scr), 0,
+	                    CopyFromParent, InputOutput, CopyFromParent,
+	                    CWOverrideRedirect | CWBackPixel, &attr);
+	XMapRaised(disp, win);
+	XSync(disp, False);
+	puts("Covered.");
+	fflush(stdout);
+	sleep(seconds);
+	XUnmapWindow(disp, win);
+	XSync(disp, False);
+	puts("Uncovered.");
+	fflush(stdout);
+	sleep(seconds);
+	XDestroyWindow(disp, win);
+	return EXIT_SUCCESS;
+}
+
+static int
+bkg(Display *const disp)
+{
+	const int scr = DefaultScreen(disp);
+	const int w = DisplayWidth(disp, scr), h = DisplayHeight(disp, scr);
+	Atom type;
+	int format, x, y, r = EXIT_FAILURE;
+	unsigned long n, after, first;
+	unsigned char *prop = NULL;
+	XImage *img;
+	Pixmap pix;
+	if (XGetWindowProperty(disp, RootWindow(disp, scr),
+	                       XInternAtom(disp, "_XROOTPMAP_ID", False), 0, 1,
+	                       False, XA_PIXMAP, &type, &format, &n, &after,
+	                       &prop) != Success || type != XA_PIXMAP || n != 1) {
+		puts("No background pixmap.");
+		goto end;
+	}
+	pix = *(Pixmap *) prop;
+	if (!(img = XGetImage(disp, pix, 0, 0, w, h, AllPlanes, ZPixmap))) {
+		puts("Cannot read the background pixmap.");
+		goto end;
+	}
+	first = XGetPixel(img, 0, 0);
+	for (y = 0; y < h && r != EXIT_SUCCESS; ++y)
+		for (x = 0; x < w; ++x)
+			if (XGetPixel(img, x, y) != first) {
+				r = EXIT_SUCCESS;
+				break;
+			}
+	puts(r == EXIT_SUCCESS ? "Background drawn." : "Background blank.");
+	XDestroyImage(img);
+	end:
+	if (prop)
+		XFree(prop);
+	return r;
+}
+
+static void
+usage(void)
+{
+	fputs("usage: xprobe ping | xprobe cover seconds | xprobe bkg\n", stderr);
+}
+
+int
+main(int argc, char *argv[])
+{
+	Display *disp;
+	char *end;
+	unsigned long seconds = 0;
+	int r = EXIT_SUCCESS, isbkg = 0;
+	if (argc == 3 && !strcmp(argv[1], "cover")) {
+		seconds = strtoul(argv[2], &end, 10);
+		if (*end || !seconds)
+			goto errusage;
+	} else if (argc == 2 && !strcmp(argv[1], "bkg")) {
+		isbkg = 1;
+	} else if (argc != 2 || strcmp(argv[1], "ping")) {
+		goto errusage;
+	}
+	if (!(disp = XOpenDisplay(NULL))) {
+		fputs("Error: failed to open X display.\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (seconds)
+		r = cover(disp, seconds);
+	else if (isbkg)
+		r = bkg(disp);
+	XCloseDisplay(disp);
+	return r;
+
+	errusage:
+	usage();
+	return EXIT_FAILURE;
+}